@@ -88,6 +88,20 @@ int copyFile(char *src, char *dst) {
 		return -1;
 	}
 
+	// Map the source and write it out in one go; fall back to a read
+	// loop for empty files or if the mapping fails.
+	struct stat st;
+	char *p;
+	if (fstat(fd_src, &st) == 0 && st.size > 0 &&
+	    (p = mmap(0, st.size, PROT_READ, MAP_PRIVATE, fd_src, 0)) !=
+		    MAP_FAILED) {
+		int ok = write(fd_dst, p, st.size) == st.size;
+		munmap(p, st.size);
+		close(fd_src);
+		close(fd_dst);
+		return ok ? 0 : -1;
+	}
+
 	char buf[512];
 	int n;
 	while ((n = read(fd_src, buf, sizeof(buf))) > 0) {
@@ -285,7 +285,15 @@ void executeCommand(char *buffer) {
 		}
 	}
 
-	int pid = fork();
+	// No output from an earlier command may show up as this one's.
+	memset(read_buf, 0, READBUFFERSIZE);
+
+	int fd[3] = {0, 1, 2};
+	if (!isGUI && pipe_fds[1] >= 0)
+		fd[1] = pipe_fds[1];
+	int pid = spawncmd(buffer, fd);
+	if (pid == -2)
+		pid = fork();
 	if (pid < 0) {
 		if (pipe_fds[0] >= 0) {
 			close(pipe_fds[0]);
@@ -307,8 +315,6 @@ void executeCommand(char *buffer) {
 		exit();
 	} else {
 		// Parent
-		memset(read_buf, 0, READBUFFERSIZE);
-
 		if (!isGUI && pipe_fds[0] >= 0) {
 			close(pipe_fds[1]);
 			int n, totalRead = 0;
@@ -15,7 +15,9 @@ struct buf {
 	struct buf *prev; // LRU cache list
 	struct buf *next;
 	struct buf *qnext; // disk queue
-	uchar data[BSIZE]; // Menggunakan BSIZE dari param.h
+	struct buf *hnext; // buffer cache hash chain
+	uchar *data;	   // BSIZE bytes (see binit)
+	void (*iodone)(struct buf *); // called when idesubmit'd I/O ends
 };
 
 #define B_VALID 0x2
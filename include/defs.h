@@ -8,9 +8,15 @@ struct buf;
 struct context;
 struct file;
 struct inode;
+struct lockstat;
+struct memstat;
+struct pcidev;
 struct pipe;
 struct proc;
+struct rastate;
 struct rtcdate;
+struct shmseg;
+struct slabcache;
 struct spinlock;
 struct sleeplock;
 struct stat;
@@ -55,8 +61,15 @@ void drawRectBorder(struct RGB *buf, struct RGB color, int x, int y, int width,
 // bio.c
 void binit(void);
 struct buf *bread(uint, uint);
+struct buf *bgetblk(uint, uint);
+void breadahead(uint, uint);
 void brelse(struct buf *);
+void bdone(struct buf *);
 void bwrite(struct buf *);
+void bstart(struct buf *);
+void bwait(struct buf **, int);
+int bcachesize(void);
+void bforget(uint, uint);
 
 // console.c
 void consoleinit(void);
@@ -64,8 +77,13 @@ void cprintf(char *, ...);
 void consoleintr(int (*)(void));
 void panic(char *) __attribute__((noreturn));
 
+// e820.c
+extern uint phystop;
+void e820init(void);
+
 // exec.c
 int exec(char *, char **);
+int execproc(struct proc *, char *, char **);
 
 // file.c
 struct file *filealloc(void);
@@ -92,6 +110,7 @@ int namecmp(const char *, const char *);
 struct inode *namei(char *);
 struct inode *nameiparent(char *, char *);
 int readi(struct inode *, char *, uint, uint);
+int readira(struct inode *, char *, uint, uint, struct rastate *);
 void stati(struct inode *, struct stat *);
 int writei(struct inode *, char *, uint, uint);
 
@@ -99,6 +118,9 @@ int writei(struct inode *, char *, uint, uint);
 void ideinit(void);
 void ideintr(void);
 void iderw(struct buf *);
+void idesubmit(struct buf *);
+void iowait(struct buf **, int);
+void iofinish(struct buf *, int);
 
 // ioapic.c
 void ioapicenable(int irq, int cpu);
@@ -107,9 +129,16 @@ void ioapicinit(void);
 
 // kalloc.c
 char *kalloc(void);
+char *kalloc_zeroed(void);
+char *kalloc_pages(int);
 void kfree(char *);
+void kfree_pages(char *, int);
+void kmemstat(struct memstat *);
+void kincref(char *);
+int krefcount(char *);
 void kinit1(void *, void *);
 void kinit2(void *, void *);
+void kzeroidle(void);
 
 // kbd.c
 void kbdintr(void);
@@ -130,6 +159,10 @@ void microdelay(int);
 // log.c
 void initlog(int dev);
 void log_write(struct buf *);
+void log_revoke(uint);
+void logflush(void);
+void logforce(void);
+void logthread(void);
 void begin_op();
 void end_op();
 
@@ -137,11 +170,24 @@ void end_op();
 extern int ismp;
 void mpinit(void);
 
+// pcache.c
+void pcacheinit(void);
+char *pcacheget(struct inode *, uint, uint, int);
+void pcacheinval(struct inode *);
+int pcachehas(uint, uint);
+
 // picirq.c
 void picenable(int);
 void picinit(void);
 
+// pci.c
+void pciinit(void);
+int pcifind(struct pcidev *, int, int, int, int);
+uint pciread(struct pcidev *, int);
+void pciwrite(struct pcidev *, int, uint);
+
 // pipe.c
+void pipeinit(void);
 int pipealloc(struct file **, struct file **);
 void pipeclose(struct pipe *, int);
 int piperead(struct pipe *, char *, int);
@@ -158,10 +204,14 @@ struct cpu *mycpu(void);
 struct proc *myproc();
 void pinit(void);
 void procdump(void);
+struct proc *proclock(void);
+void procunlock(void);
 void scheduler(void) __attribute__((noreturn));
 void sched(void);
 void setproc(struct proc *);
 void sleep(void *, struct spinlock *);
+int spawn(char *, char **, int *);
+int kthread(char *, void (*)(void));
 void userinit(void);
 int wait(void);
 void wakeup(void *);
@@ -170,11 +220,35 @@ void yield(void);
 // swtch.S
 void swtch(struct context **, struct context *);
 
+// shm.c
+void shminit(void);
+int shmget(int, uint);
+int shmat(int);
+int shmdt(uint);
+int shmfork(struct proc *, struct proc *);
+void shmexit(struct proc *);
+void shmdisown(struct proc *);
+int shmcheck(struct proc *, uint, uint);
+
+// swap.c
+void swapinit(int);
+int swapsize(void);
+void swapdup(uint);
+void swapfree(uint);
+int swapout(int);
+void swapin(char *, uint);
+
+// slab.c
+void slabinit(struct slabcache *, char *, uint);
+void *slaballoc(struct slabcache *);
+void slabfree(struct slabcache *, void *);
+
 // spinlock.c
 void acquire(struct spinlock *);
 void getcallerpcs(void *, uint *);
 int holding(struct spinlock *);
 void initlock(struct spinlock *, char *);
+int lockstats(struct lockstat *, int);
 void release(struct spinlock *);
 void pushcli(void);
 void popcli(void);
@@ -197,6 +271,7 @@ char *strncpy(char *, const char *, int);
 // syscall.c
 int argint(int, int *);
 int argptr(int, char **, int);
+int argwptr(int, char **, int);
 int argstr(int, char **);
 int fetchint(uint, int *);
 int fetchstr(uint, char **);
@@ -216,9 +291,15 @@ void uartinit(void);
 void uartintr(void);
 void uartputc(int);
 
+// virtio.c
+int virtioinit(void);
+int virtiointr(int);
+void virtiosubmit(struct buf *);
+
 // vm.c
 void seginit(void);
 void kvmalloc(void);
+void kvmenable(void);
 pde_t *setupkvm(void);
 char *uva2ka(pde_t *, char *);
 int allocuvm(pde_t *, uint, uint);
@@ -226,11 +307,25 @@ int deallocuvm(pde_t *, uint, uint);
 void freevm(pde_t *);
 void inituvm(pde_t *, char *, uint);
 int loaduvm(pde_t *, char *, struct inode *, uint, uint);
-pde_t *copyuvm(pde_t *, uint);
+pde_t *copyuvm(struct proc *);
 void switchuvm(struct proc *);
 void switchkvm(void);
 int copyout(pde_t *, uint, void *, uint);
 void clearpteu(pde_t *pgdir, char *uva);
+int pagefault(struct proc *, uint, uint, int);
+int vmprefault(struct proc *, uint, uint);
+void vmhold(struct proc *, uint, uint);
+int vmpin(struct proc *, uint, uint);
+uint *vmclock(struct proc *, uint *);
+int mapshared(pde_t *, uint, char **, int);
+void vmadup(struct proc *, struct proc *);
+int vmacheck(struct proc *, uint, uint);
+int vmareadonly(struct proc *, uint, uint);
+uint vmamapfloor(struct proc *);
+int vmamap(struct proc *, struct inode *, uint, uint, uint, int);
+int vmaunmap(struct proc *, uint, uint);
+void vmaput(struct proc *);
+int vmcharge(uint, uint);
 
 // rtc.c
 void            rtc_init(void);
@@ -6,4 +6,11 @@
 #define O_RDWR 0x002
 #define O_CREATE 0x200
 
+// mmap() protection and flags
+#define PROT_READ 0x1
+#define PROT_WRITE 0x2
+#define MAP_SHARED 0x1	// not supported
+#define MAP_PRIVATE 0x2
+#define MAP_FAILED ((void *)-1)
+
 #endif // FCNTL_H
\ No newline at end of file
@@ -5,6 +5,13 @@
 #include "sleeplock.h" // Diperlukan agar struct sleeplock diketahui ukurannya
 #include "types.h"
 
+// How far a sequential reader has got, for read-ahead. Kept per
+// open file, so readers of the same inode do not disturb each other.
+struct rastate {
+	uint pos; // block after the last one read
+	uint end; // first block not yet read ahead
+};
+
 struct file {
 	enum { FD_NONE, FD_PIPE, FD_INODE } type;
 	int ref; // reference count
@@ -13,6 +20,14 @@ struct file {
 	struct pipe *pipe;
 	struct inode *ip;
 	uint off;
+	struct rastate ra; // read-ahead state of this open
+};
+
+// Where a lookup among an extent inode's extents stands.
+struct extcur {
+	struct extent e; // extent found last, or len 0
+	uint first;	 // file block e starts at
+	int idx;	 // index of e among the extents
 };
 
 // in-memory copy of an inode
@@ -28,7 +43,10 @@ struct inode {
 	short minor;
 	short nlink;
 	uint size;
-	uint addrs[NDIRECT + 1];
+	uint flags;
+	uint addrs[NDIRECT + 2];
+	int pcached; // page cache may hold pages of this file
+	struct extcur xc; // where bmap last found a block
 };
 
 // table mapping major device number to
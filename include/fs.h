@@ -15,6 +15,8 @@ struct superblock {
   uint inodestart;   // First inode block
   uint bmapstart;    // First free map block
   uint checksum;     // Fletcher-32 Checksum integritas metadata
+  uint swapstart;    // First swap block, past the file system
+  uint nswap;        // Number of swap blocks, 0 if none
 };
 
 #define NDIRECT 10
@@ -22,6 +24,22 @@ struct superblock {
 #define NDINDIRECT (NINDIRECT * NINDIRECT)
 #define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
 
+// Inodes with I_EXTENT set map their blocks as runs of contiguous
+// disk blocks instead: addrs[] holds the first NIEXTENT runs, then
+// the block holding the rest and the number of runs in use. A file
+// has no holes, so run i starts at the file block where run i-1
+// ends.
+struct extent {
+  uint start; // First disk block
+  uint len;   // Number of blocks
+};
+
+#define I_EXTENT 0x1
+#define NIEXTENT (NDIRECT / 2)
+#define NXEXTENT (BSIZE / sizeof(struct extent))
+#define EXTBLOCK NDIRECT       // addrs[] slot of the extent block
+#define EXTCOUNT (NDIRECT + 1) // addrs[] slot of the number of runs
+
 // Struktur data inti inode
 struct dinode_core {
   short type;           
@@ -33,6 +51,7 @@ struct dinode_core {
   uint atime;           // Access time
   uint mtime;           // Modified time
   uint ctime;           // Creation time
+  uint flags;           // I_EXTENT
 };
 
 // Union memastikan secara matematis ukuran struct adalah 128 byte
@@ -0,0 +1,17 @@
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+#include "types.h"
+
+// Contention counters for one class of kernel spinlocks, as returned by
+// the lockstat() system call. Locks that share a name (for example the
+// per-buffer "sleep lock"s) are summed into a single entry.
+struct lockstat {
+	char name[16];	   // Lock name given to initlock()
+	uint nlocks;	   // Number of locks summed into this entry
+	uint nacquire;	   // Total acquisitions
+	uint ncontended;   // Acquisitions that found the lock held
+	uint64 spincycles; // TSC cycles spent spinning
+};
+
+#endif // LOCKSTAT_H
@@ -1,12 +1,16 @@
 // Memory layout
 
 #define EXTMEM 0x100000	    // Start of extended memory
-#define PHYSTOP 0x8000000   // Top physical memory (128 MB)
+#define PHYSTOP 0x8000000   // Top physical memory if the BIOS gives no map
 #define DEVSPACE 0xFC000000 // Other devices are at high addresses
+#define E820MAP 0x2000	    // BIOS memory map left by bootasm.S
 
 // Key addresses for address space layout (see kmap in vm.c for layout)
 #define KERNBASE 0x80000000	     // First kernel virtual address
 #define KERNLINK (KERNBASE + EXTMEM) // Address where kernel is linked
+#define PHYSMAX (DEVSPACE - KERNBASE) // Most physical memory mapped at KERNBASE
+#define SHMBASE 0x7F000000 // Shared memory attach slots, up to KERNBASE
+#define SHMMAX 0x400000	   // Largest shared memory segment (4 MB)
 
 #define V2P(a) (((uint)(a)) - KERNBASE)
 #define P2V(a) ((void *)(((char *)(a)) + KERNBASE))
@@ -0,0 +1,19 @@
+#ifndef MEMSTAT_H
+#define MEMSTAT_H
+
+#include "types.h"
+
+#define MAXORDER 10 // Largest buddy block: 2^10 pages, 4 MB
+
+// State of the physical page allocator, as returned by the memstat()
+// system call. Free pages are either in buddy blocks, in the per-CPU
+// caches, or in the pool of pre-zeroed pages.
+struct memstat {
+	uint npages;		    // Pages managed by the allocator
+	uint nfree;		    // Free pages in all of the below
+	uint nblocks[MAXORDER + 1]; // Free buddy blocks of each order
+	uint ncached;		    // Free pages in per-CPU caches
+	uint nzeroed;		    // Free pages already zeroed
+};
+
+#endif // MEMSTAT_H
@@ -14,6 +14,7 @@
 #define CR0_PG 0x80000000 // Paging
 
 #define CR4_PSE 0x00000010 // Page size extension
+#define CR4_PGE 0x00000080 // Page global enable
 
 // various segment selectors.
 #define SEG_KCODE 1 // kernel code
@@ -21,9 +22,10 @@
 #define SEG_UCODE 3 // user code
 #define SEG_UDATA 4 // user data+stack
 #define SEG_TSS 5   // this process's task state
+#define SEG_KCPU 6  // kernel per-cpu data, loaded into %gs
 
 // cpu->gdt[NSEGS] holds the above segments.
-#define NSEGS 6
+#define NSEGS 7
 
 #ifndef __ASSEMBLER__
 // Segment Descriptor
@@ -91,6 +93,7 @@ struct segdesc {
 #define NPDENTRIES 1024 // # directory entries per page directory
 #define NPTENTRIES 1024 // # PTEs per page table
 #define PGSIZE 4096	// bytes mapped by a page
+#define PGSIZE4M (NPTENTRIES * PGSIZE) // bytes mapped by a PTE_PS page
 
 #define PTXSHIFT 12 // offset of PTX in a linear address
 #define PDXSHIFT 22 // offset of PDX in a linear address
@@ -102,7 +105,18 @@ struct segdesc {
 #define PTE_P 0x001  // Present
 #define PTE_W 0x002  // Writeable
 #define PTE_U 0x004  // User
+#define PTE_A 0x020  // Accessed
+#define PTE_D 0x040  // Dirty
 #define PTE_PS 0x080 // Page Size
+#define PTE_G 0x100  // Global: kept in the TLB across %cr3 loads
+#define PTE_COW 0x200 // Copy-on-write (software bit, ignored by the MMU)
+#define PTE_SWAP 0x400 // Not present, address bits hold a swap slot (software)
+#define PTE_PIN 0x800 // Never swapped out (software bit)
+
+// Page fault error code bits (tf->err for T_PGFLT).
+#define FEC_PR 0x1 // Fault on a present page (protection violation)
+#define FEC_WR 0x2 // Fault caused by a write
+#define FEC_U 0x4  // Fault happened in user mode
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte) ((uint)(pte) & ~0xFFF)
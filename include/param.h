@@ -5,19 +5,37 @@
 #define KSTACKSIZE   4096      // Size of per-process kernel stack
 #define NCPU         8         // Maximum number of CPUs
 #define NOFILE       64        // Open files per process (increased for game assets)
-#define NFILE        100       // Open files per system
 #define NINODE       100       // Maximum number of active i-nodes (increased for icons/WADs)
 #define NDEV         10        // Maximum major device number
+#define KCACHEMAX    64        // Free pages a per-CPU kalloc cache may hold
+#define KCACHEBATCH  16        // Pages moved between a per-CPU cache and kmem at once
+#define KZEROMAX     256       // Pre-zeroed free pages kept by idle CPUs
+#define OVERCOMMIT   150       // User memory that may be committed, % of RAM
+#define NVMA         8         // File-backed memory regions per process
+#define NPCACHE      512       // Pages of file data in the page cache
+#define SLABMAG      16        // Free objects in a per-CPU slab magazine
+#define NSHM         32        // Shared memory segments per system
+#define NSHMAT       4         // Segments a process can attach: (KERNBASE-SHMBASE)/SHMMAX
+#define SWAPBATCH    16        // Pages swapped out at once when memory runs short
+#define NUHOLD       4         // User ranges a system call keeps in memory
+#define NLOCKSTAT    256       // Statically allocated spinlocks tracked by lockstat()
 #define ROOTDEV      1         // Device number of file system root disk
 #define MAXARG       32        // Max exec arguments
 #define MAXOPBLOCKS  10        // Max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS * 3) // Max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS * 3) // Size of disk block cache
+#define LOGSIZE      256       // Blocks in the on-disk log mkfs makes
+#define NBUF         (MAXOPBLOCKS * 9) // Minimum size of disk block cache
+#define BCACHEPCT    10        // Memory for the disk block cache, % of RAM
+#define LOGDIRTY     50        // % of the log uninstalled blocks may fill
+#define FLUSHTICKS   100       // Ticks between background flushes
+#define GROUPTICKS   10        // Ticks a transaction gathers FS calls
+#define GROUPPCT     25        // % of the log that commits a transaction
+#define NREADAHEAD   16        // Blocks read ahead of a sequential reader
 
 // File System Configuration for ~50 MB Disk
 // Calculation: (50 * 1024 * 1024) / 2048 (BSIZE) = 25,600 blocks
 // Actual size: 25,600 * 2048 = 52,428,800 bytes = ~50 MB
 #define FSSIZE       25600     // ~50 MB file system
+#define SWAPSIZE     8192      // Blocks of swap space after the file system (16 MB)
 #define BSIZE        2048      // Block size in bytes
 
 #endif
\ No newline at end of file
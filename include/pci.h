@@ -0,0 +1,38 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include "types.h"
+
+// A PCI function, as found by pcifind.
+struct pcidev {
+	uchar bus;
+	uchar dev;
+	uchar func;
+	ushort vendor;
+	ushort device;
+	uchar class;
+	uchar subclass;
+	uchar progif;
+	uchar irq;    // Legacy interrupt line the BIOS routed it to
+	uint bar[6];  // Base address registers, flag bits included
+};
+
+#define PCI_ANY (-1) // Wildcard for pcifind
+
+// Configuration space registers
+#define PCI_ID 0x00	  // Vendor and device ID
+#define PCI_COMMAND 0x04  // Command (low 16 bits), status
+#define PCI_CLASS 0x08	  // Revision, prog-if, subclass, class
+#define PCI_BAR0 0x10	  // First base address register
+#define PCI_INTLINE 0x3C  // Interrupt line, pin
+
+#define PCI_CMD_IO 0x1	   // Respond to I/O space accesses
+#define PCI_CMD_MEM 0x2	   // Respond to memory space accesses
+#define PCI_CMD_MASTER 0x4 // May act as bus master
+
+#define PCI_BAR_IO 0x1 // BAR is in I/O space
+
+#define PCI_CLASS_STORAGE 0x01
+#define PCI_SUB_IDE 0x01
+
+#endif // PCI_H
@@ -12,9 +12,14 @@ struct cpu {
 	struct taskstate ts;	   // Used by x86 to find stack for interrupt
 	struct segdesc gdt[NSEGS]; // x86 global descriptor table
 	volatile uint started;	   // Has the CPU started?
-	int ncli;		   // Depth of pushcli nesting.
-	int intena;		   // Were interrupts enabled before pushcli?
-	struct proc *proc;	   // The process running on this cpu or null
+
+	// Cpu-local storage, addressed through the SEG_KCPU segment in %gs
+	// (see seginit). mycpu() and myproc() read the first two fields
+	// with a single %gs-relative load, so keep their order fixed.
+	struct cpu *self;  // %gs:0, points back at this struct cpu
+	struct proc *proc; // %gs:4, the process running on this cpu or null
+	int ncli;	   // Depth of pushcli nesting.
+	int intena;	   // Were interrupts enabled before pushcli?
 };
 
 extern struct cpu cpus[NCPU];
@@ -31,6 +36,23 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// A region of user memory backed by a file and read in page by page
+// on first touch (see filefault in vm.c).
+struct vma {
+	uint start;	  // First virtual address, page-aligned
+	uint end;	  // One past the last virtual address, page-aligned
+	struct inode *ip; // File the pages come from, or 0 if slot unused
+	uint off;	  // File offset of start
+	uint filesz;	  // Bytes of file data; the rest of the last page is 0
+	int writable;	  // Private writable copy on write, else read-only
+};
+
+// A range of user memory, [start, end).
+struct urange {
+	uint start;
+	uint end;
+};
+
 // Per-process state
 struct proc {
 	uint sz;		    // Size of process memory (bytes)
@@ -45,6 +67,10 @@ struct proc {
 	int killed;		    // If non-zero, have been killed
 	struct file *ofile[NOFILE]; // Open files
 	struct inode *cwd;	    // Current directory
+	struct vma vma[NVMA];	    // File-backed memory regions
+	struct shmseg *shm[NSHMAT]; // Attached shared memory (see shm.c)
+	struct urange hold[NUHOLD]; // User memory the current syscall uses
+	int nhold;		    // Ranges in hold; over NUHOLD means all
 	char name[16];		    // Process name (debugging)
 };
 
@@ -0,0 +1,26 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "param.h"
+#include "spinlock.h"
+#include "types.h"
+
+// Per-CPU stack of free objects in front of a slab cache.
+struct magazine {
+	int n;		     // Number of objects in obj
+	void *obj[SLABMAG]; // Free objects, most recently freed last
+};
+
+// Cache of equal-sized kernel objects carved from pages (see slab.c).
+struct slabcache {
+	struct spinlock lock; // protects everything below but mag
+	char *name;	      // Name of cache, also used for its lock
+	uint size;	      // Object size, rounded up to 8 bytes
+	uint perslab;	      // Objects in one slab
+	struct slab *partial; // Slabs with some objects free
+	struct slab *spare;   // One completely free slab kept for reuse
+	uint nslab;	      // Slabs allocated, counting spare
+	struct magazine mag[NCPU]; // Used with interrupts off, no lock
+};
+
+#endif
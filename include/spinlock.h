@@ -3,15 +3,23 @@
 
 #include "types.h"
 
-/* Mutual exclusion lock. */
+/* Mutual exclusion lock.
+ * A ticket lock: acquire() takes the next ticket and spins until
+ * owner reaches it, so waiting CPUs are served in FIFO order. */
 struct spinlock {
-	uint locked; /* Is the lock held? */
+	volatile uint next;  /* Next ticket to hand out. */
+	volatile uint owner; /* Ticket now holding the lock. */
 
 	/* For debugging: */
 	char *name;	 /* Name of lock. */
 	struct cpu *cpu; /* The cpu holding the lock. */
 	uint pcs[10];	 /* The call stack (an array of program counters)
 			    that locked the lock. */
+
+	/* Contention statistics, only updated while the lock is held: */
+	uint nacquire;	   /* Number of acquisitions. */
+	uint ncontended;   /* Acquisitions that had to wait. */
+	uint64 spincycles; /* TSC cycles spent waiting. */
 };
 
-#endif
\ No newline at end of file
+#endif
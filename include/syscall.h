@@ -37,5 +37,15 @@
 #define SYS_reboot 33
 #define SYS_get_rtc_time 34
 #define SYS_get_rtc_date 35
+#define SYS_lockstat 36
+#define SYS_memstat 37
+#define SYS_shmget 38
+#define SYS_shmat 39
+#define SYS_shmdt 40
+#define SYS_mmap 41
+#define SYS_munmap 42
+#define SYS_spawn 43
+#define SYS_sync 44
+#define SYS_fsync 45
 
 #endif
\ No newline at end of file
@@ -5,6 +5,7 @@
 typedef unsigned int uint;
 typedef unsigned short ushort;
 typedef unsigned char uchar;
+typedef unsigned long long uint64;
 typedef uint pde_t;
 #endif // __ASSEMBLER__
 
@@ -5,6 +5,8 @@
 
 struct stat;
 struct rtcdate;
+struct lockstat;
+struct memstat;
 struct RGBA;
 struct RGB;
 struct message;
@@ -47,6 +49,16 @@ int GUI_createPopupWindow(struct window *, int);
 int GUI_closePopupWindow(struct window *);
 int halt(void);
 int reboot(void);
+int lockstat(struct lockstat *, int);
+int memstat(struct memstat *);
+int shmget(int, uint);
+void *shmat(int);
+int shmdt(void *);
+void *mmap(void *, uint, int, int, int, int);
+int munmap(void *, uint);
+int spawn(char *, char **, int *);
+int sync(void);
+int fsync(int);
 
 // Real-Time Clock System Calls (Update Northos)
 int get_rtc_time(int *hours, int *minutes, int *seconds);
@@ -66,6 +78,7 @@ void *memset(void *, int, uint);
 void *malloc(uint);
 void free(void *);
 int atoi(const char *);
+int spawncmd(char *, int *);
 
 // user_window.c
 void debugPrintWidgetList(struct window *win);
@@ -22,6 +22,24 @@ static inline void outw(ushort port, ushort data) {
 	asm volatile("out %0,%1" : : "a"(data), "d"(port));
 }
 
+static inline ushort inw(ushort port) {
+	ushort data;
+
+	asm volatile("in %1,%0" : "=a"(data) : "d"(port));
+	return data;
+}
+
+static inline uint inl(ushort port) {
+	uint data;
+
+	asm volatile("in %1,%0" : "=a"(data) : "d"(port));
+	return data;
+}
+
+static inline void outl(ushort port, uint data) {
+	asm volatile("out %0,%1" : : "a"(data), "d"(port));
+}
+
 static inline void outsl(int port, const void *addr, int cnt) {
 	asm volatile("cld; rep outsl"
 		     : "=S"(addr), "=c"(cnt)
@@ -94,16 +112,47 @@ static inline uint xchg(volatile uint *addr, uint newval) {
 	return result;
 }
 
+// Read the time-stamp counter.
+static inline uint64 rdtsc(void) {
+	uint64 val;
+	asm volatile("rdtsc" : "=A"(val));
+	return val;
+}
+
+// Spin-wait hint; eases the pipeline and bus while polling a lock.
+static inline void pause(void) { asm volatile("pause"); }
+
 static inline uint rcr2(void) {
 	uint val;
 	asm volatile("movl %%cr2,%0" : "=r"(val));
 	return val;
 }
 
+// Flush the TLB entry for one virtual address.
+static inline void invlpg(void *va) {
+	asm volatile("invlpg (%0)" : : "r"(va) : "memory");
+}
+
+static inline uint rcr4(void) {
+	uint val;
+	asm volatile("movl %%cr4,%0" : "=r"(val));
+	return val;
+}
+
+static inline void lcr4(uint val) {
+	asm volatile("movl %0,%%cr4" : : "r"(val));
+}
+
 static inline void lcr3(uint val) {
 	asm volatile("movl %0,%%cr3" : : "r"(val));
 }
 
+static inline uint rcr3(void) {
+	uint val;
+	asm volatile("movl %%cr3,%0" : "=r"(val));
+	return val;
+}
+
 // PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().
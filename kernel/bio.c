@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -17,88 +17,260 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// binit sizes the cache at boot to BCACHEPCT percent of memory.
+// Buffers are found by hashing (dev, blockno), with a lock per hash
+// bucket, so lookups of different blocks do not contend. All buffers
+// are also on one LRU list under bcache.lock, most recently released
+// first, and a miss recycles the least recently used buffer not in
+// use. bcache.lock also serializes misses, so two processes missing
+// on the same block cannot both load it. Lock order: bcache.lock,
+// then a bucket lock.
+//
+// Disk I/O need not be waited for one block at a time:
+// * breadahead starts reading a block and returns. The buffer stays
+//     locked until the read finishes, when the disk interrupt passes
+//     it to bdone; a bread of the block meanwhile waits on the lock.
+// * bstart starts writing a locked buffer; bwait waits for a set of
+//     them, which the disk may handle in any order.
 
 #include "buf.h" // Membutuhkan uint (dari types) dan BSIZE (dari param)
 #include "defs.h"
 #include "fs.h"
+#include "memlayout.h"
+#include "mmu.h"
 #include "param.h" // Mendefinisikan BSIZE
 #include "sleeplock.h"
 #include "spinlock.h"
 #include "types.h" // Mendefinisikan uint, uchar, dll
 
+extern char end[]; // first address after kernel loaded from ELF file
+
+struct bucket {
+	struct spinlock lock;
+	struct buf *head; // Hash chain, through hnext
+};
+
 struct {
 	struct spinlock lock;
-	struct buf buf[NBUF];
+	struct bucket *bucket;
+	uint nbucket; // A power of two
+	int nbuf;
 
 	// Linked list of all buffers, through prev/next.
 	// head.next is most recently used.
 	struct buf head;
 } bcache;
 
-void binit(void) {
+static struct bucket *bbucket(uint dev, uint blockno) {
+	return &bcache.bucket[(blockno + dev * 4099) & (bcache.nbucket - 1)];
+}
+
+// Find the buffer for a block in bk. Caller holds bk->lock.
+static struct buf *bfind(struct bucket *bk, uint dev, uint blockno) {
 	struct buf *b;
 
+	for (b = bk->head; b; b = b->hnext)
+		if (b->dev == dev && b->blockno == blockno)
+			return b;
+	return 0;
+}
+
+// Take b off bk's hash chain, if it is there. Caller holds bk->lock.
+static void bunhash(struct bucket *bk, struct buf *b) {
+	struct buf **pp;
+
+	for (pp = &bk->head; *pp; pp = &(*pp)->hnext) {
+		if (*pp == b) {
+			*pp = b->hnext;
+			break;
+		}
+	}
+	b->hnext = 0;
+}
+
+// Size the cache from the memory there is, and carve the buffers and
+// their data out of whole pages. Called once all memory is free.
+void binit(void) {
+	struct buf *b, *hdr;
+	char *data;
+	int n, nhdr, ndata, order;
+	uint i;
+
 	initlock(&bcache.lock, "bcache");
 
+	n = (phystop - V2P(end)) / PGSIZE / 100 * BCACHEPCT * (PGSIZE / BSIZE);
+	if (n > FSSIZE)
+		n = FSSIZE;
+	if (n < NBUF)
+		n = NBUF;
+	for (bcache.nbucket = 16; bcache.nbucket < n / 8; bcache.nbucket *= 2)
+		;
+	order = 0;
+	while ((PGSIZE << order) < bcache.nbucket * sizeof(struct bucket))
+		order++;
+	bcache.bucket = (struct bucket *)kalloc_pages(order);
+	if (bcache.bucket == 0)
+		panic("binit");
+	for (i = 0; i < bcache.nbucket; i++) {
+		initlock(&bcache.bucket[i].lock, "bcache.bucket");
+		bcache.bucket[i].head = 0;
+	}
+
 	// PAGEBREAK!
 	// Create linked list of buffers
 	bcache.head.prev = &bcache.head;
 	bcache.head.next = &bcache.head;
-	for (b = bcache.buf; b < bcache.buf + NBUF; b++) {
+	hdr = 0;
+	data = 0;
+	nhdr = ndata = 0;
+	for (bcache.nbuf = 0; bcache.nbuf < n; bcache.nbuf++) {
+		if (nhdr == 0) {
+			if ((hdr = (struct buf *)kalloc()) == 0)
+				break;
+			nhdr = PGSIZE / sizeof(struct buf);
+		}
+		if (ndata == 0) {
+			if ((data = kalloc()) == 0)
+				break;
+			ndata = PGSIZE / BSIZE;
+		}
+		b = hdr++;
+		nhdr--;
+		memset(b, 0, sizeof(*b));
+		b->data = (uchar *)data;
+		data += BSIZE;
+		ndata--;
 		b->next = bcache.head.next;
 		b->prev = &bcache.head;
 		initsleeplock(&b->lock, "buffer");
 		bcache.head.next->prev = b;
 		bcache.head.next = b;
 	}
+	if (bcache.nbuf < NBUF)
+		panic("binit: out of memory");
+	cprintf("bcache: %d buffers, %d buckets\n", bcache.nbuf,
+		bcache.nbucket);
 }
 
+// Number of buffers in the cache.
+int bcachesize(void) { return bcache.nbuf; }
+
 // Look through buffer cache for block on device dev.
 // If not found, allocate a buffer.
-// In either case, return locked buffer.
-static struct buf *bget(uint dev, uint blockno) {
+// In either case, return locked buffer; if missonly is set, return 0
+// for a block already cached instead.
+static struct buf *bget(uint dev, uint blockno, int missonly) {
+	struct bucket *bk, *old;
 	struct buf *b;
 
-	acquire(&bcache.lock);
+	bk = bbucket(dev, blockno);
+	acquire(&bk->lock);
 
 	// Is the block already cached?
-	for (b = bcache.head.next; b != &bcache.head; b = b->next) {
-		if (b->dev == dev && b->blockno == blockno) {
+	if ((b = bfind(bk, dev, blockno)) != 0) {
+		if (missonly) {
+			release(&bk->lock);
+			return 0;
+		}
+		b->refcnt++;
+		release(&bk->lock);
+		acquiresleep(&b->lock);
+		return b;
+	}
+	release(&bk->lock);
+
+	// Not cached. Look again with misses locked out, in case another
+	// process loaded the block in the meantime.
+	acquire(&bcache.lock);
+	acquire(&bk->lock);
+	if ((b = bfind(bk, dev, blockno)) != 0) {
+		if (missonly)
+			b = 0;
+		else
 			b->refcnt++;
-			release(&bcache.lock);
+		release(&bk->lock);
+		release(&bcache.lock);
+		if (b)
 			acquiresleep(&b->lock);
-			return b;
-		}
+		return b;
 	}
+	release(&bk->lock);
 
-	// Not cached; recycle an unused buffer.
+	// Recycle the least recently used unused buffer.
 	// Even if refcnt==0, B_DIRTY indicates a buffer is in use
 	// because log.c has modified it but not yet committed it.
 	for (b = bcache.head.prev; b != &bcache.head; b = b->prev) {
+		old = bbucket(b->dev, b->blockno);
+		acquire(&old->lock);
 		if (b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-			b->dev = dev;
-			b->blockno = blockno;
-			b->flags = 0;
-			b->refcnt = 1;
-			release(&bcache.lock);
-			acquiresleep(&b->lock);
-			return b;
+			bunhash(old, b);
+			release(&old->lock);
+			break;
 		}
+		release(&old->lock);
 	}
-	panic("bget: no buffers");
+	if (b == &bcache.head)
+		panic("bget: no buffers");
+	b->dev = dev;
+	b->blockno = blockno;
+	b->flags = 0;
+	b->refcnt = 1;
+	acquire(&bk->lock);
+	b->hnext = bk->head;
+	bk->head = b;
+	release(&bk->lock);
+	release(&bcache.lock);
+	acquiresleep(&b->lock);
+	return b;
 }
 
 // Return a locked buf with the contents of the indicated block.
 struct buf *bread(uint dev, uint blockno) {
 	struct buf *b;
 
-	b = bget(dev, blockno);
+	b = bget(dev, blockno, 0);
 	if ((b->flags & B_VALID) == 0) {
 		iderw(b);
 	}
 	return b;
 }
 
+// Return a locked buf for the indicated block, to be overwritten in
+// full: its old contents are not read from disk.
+struct buf *bgetblk(uint dev, uint blockno) {
+	struct buf *b;
+
+	b = bget(dev, blockno, 0);
+	b->flags |= B_VALID;
+	return b;
+}
+
+// Unpin the indicated block, whose contents the log no longer needs,
+// so its buffer can be recycled without being written.
+void bforget(uint dev, uint blockno) {
+	struct buf *b;
+
+	b = bget(dev, blockno, 0);
+	b->flags &= ~B_DIRTY;
+	brelse(b);
+}
+
+// Start reading the indicated block into the cache, unless it is
+// there already, and return without waiting for it.
+void breadahead(uint dev, uint blockno) {
+	struct buf *b;
+
+	if ((b = bget(dev, blockno, 1)) == 0)
+		return;
+	if (b->flags & B_VALID) {
+		brelse(b);
+		return;
+	}
+	b->iodone = bdone;
+	idesubmit(b);
+}
+
 // Write b's contents to disk.  Must be locked.
 void bwrite(struct buf *b) {
 	if (!holdingsleep(&b->lock))
@@ -107,27 +279,59 @@ void bwrite(struct buf *b) {
 	iderw(b);
 }
 
-// Release a locked buffer.
-// Move to the head of the MRU list.
-void brelse(struct buf *b) {
+// Start writing b's contents to disk and return at once. b stays
+// locked; pass it to bwait before releasing it.
+void bstart(struct buf *b) {
 	if (!holdingsleep(&b->lock))
-		panic("brelse");
+		panic("bstart");
+	b->flags |= B_DIRTY;
+	idesubmit(b);
+}
 
-	releasesleep(&b->lock);
+// Wait for the n buffers given to bstart to reach the disk.
+void bwait(struct buf **bs, int n) { iowait(bs, n); }
 
-	acquire(&bcache.lock);
+// Drop a reference to b, whose lock was just released, and move it
+// to the head of the MRU list if it is no longer in use.
+static void bput(struct buf *b) {
+	struct bucket *bk;
+	int idle;
+
+	bk = bbucket(b->dev, b->blockno);
+	acquire(&bk->lock);
 	b->refcnt--;
-	if (b->refcnt == 0) {
+	idle = b->refcnt == 0;
+	release(&bk->lock);
+
+	if (idle) {
 		// no one is waiting for it.
+		acquire(&bcache.lock);
 		b->next->prev = b->prev;
 		b->prev->next = b->next;
 		b->next = bcache.head.next;
 		b->prev = &bcache.head;
 		bcache.head.next->prev = b;
 		bcache.head.next = b;
+		release(&bcache.lock);
 	}
+}
 
-	release(&bcache.lock);
+// Release a locked buffer.
+// Move to the head of the MRU list.
+void brelse(struct buf *b) {
+	if (!holdingsleep(&b->lock))
+		panic("brelse");
+
+	releasesleep(&b->lock);
+	bput(b);
+}
+
+// Release a buffer whose asynchronous I/O has finished. Called from
+// the disk interrupt, not by the process that locked the buffer, so
+// the holder is not checked.
+void bdone(struct buf *b) {
+	releasesleep(&b->lock);
+	bput(b);
 }
 // PAGEBREAK!
 // Blank page.
@@ -0,0 +1,51 @@
+// Physical memory detection.
+//
+// bootasm.S asks the BIOS for the E820 address map while still in real
+// mode and leaves it at E820MAP. The kernel uses the usable range
+// starting below EXTMEM, in which it was loaded, as all of memory: it
+// runs from EXTMEM to phystop with no holes. Memory past the first
+// hole, and past PHYSMAX, which is all that fits in the kernel's
+// direct map between KERNBASE and DEVSPACE, is left unused.
+
+#include "defs.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "types.h"
+
+#define E820_RAM 1 // Usable memory
+#define E820_MAX 128 // More entries than that means a garbled map
+
+struct e820entry {
+	uint addrlo, addrhi;
+	uint lenlo, lenhi;
+	uint type;
+};
+
+uint phystop; // Top of usable physical memory
+
+void e820init(void) {
+	struct e820entry *e, *eend;
+	uint mapend, top, end;
+
+	mapend = *(ushort *)P2V(E820MAP);
+	e = (struct e820entry *)P2V(E820MAP + 4);
+	eend = (struct e820entry *)P2V(mapend);
+	if (eend < e || eend > e + E820_MAX)
+		eend = e;
+
+	top = 0;
+	for (; e < eend; e++) {
+		if (e->type != E820_RAM || e->addrhi != 0)
+			continue;
+		end = e->addrlo + e->lenlo;
+		if (e->lenhi != 0 || end < e->addrlo)
+			end = 0xFFFFFFFF; // runs past 4 GB
+		if (e->addrlo <= EXTMEM && end > EXTMEM)
+			top = end;
+	}
+	if (top == 0)
+		top = PHYSTOP;
+	if (top > PHYSMAX)
+		top = PHYSMAX;
+	phystop = PGROUNDDOWN(top);
+}
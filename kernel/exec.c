@@ -1,5 +1,6 @@
 #include "defs.h"
 #include "elf.h"
+#include "file.h"
 #include "memlayout.h"
 #include "mmu.h"
 #include "param.h"
@@ -7,15 +8,20 @@
 #include "types.h"
 #include "x86.h"
 
-int exec(char *path, char **argv) {
+int exec(char *path, char **argv) { return execproc(myproc(), path, argv); }
+
+// Replace p's user memory with the program at path, run with the
+// arguments argv. p is the current process, or a child spawn is
+// setting up, which has no memory yet and has not run.
+int execproc(struct proc *p, char *path, char **argv) {
 	char *s, *last;
-	int i, off;
+	int i, nvma, off;
 	uint argc, sz, sp, ustack[3 + MAXARG + 1];
 	struct elfhdr elf;
 	struct inode *ip;
 	struct proghdr ph;
+	struct vma vma[NVMA];
 	pde_t *pgdir, *oldpgdir;
-	struct proc *curproc = myproc();
 
 	begin_op();
 
@@ -36,8 +42,12 @@ int exec(char *path, char **argv) {
 	if ((pgdir = setupkvm()) == 0)
 		goto bad;
 
-	// Load program into memory.
+	// Describe the program's segments. Nothing is read yet: pages
+	// are faulted in from the page cache on first touch (see
+	// filefault in vm.c), and the bss is zero-filled like sbrk
+	// memory. The segments keep a reference to ip.
 	sz = 0;
+	nvma = 0;
 	for (i = 0, off = elf.phoff; i < elf.phnum; i++, off += sizeof(ph)) {
 		if (readi(ip, (char *)&ph, off, sizeof(ph)) != sizeof(ph))
 			goto bad;
@@ -47,20 +57,35 @@ int exec(char *path, char **argv) {
 			goto bad;
 		if (ph.vaddr + ph.memsz < ph.vaddr)
 			goto bad;
-		if ((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+		if (ph.vaddr + ph.memsz >= KERNBASE)
 			goto bad;
 		if (ph.vaddr % PGSIZE != 0)
 			goto bad;
-		if (loaduvm(pgdir, (char *)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+		if (ph.vaddr < PGROUNDUP(sz))
+			goto bad;
+		if (ph.off + ph.filesz < ph.off || ph.off + ph.filesz > ip->size)
 			goto bad;
+		sz = ph.vaddr + ph.memsz;
+		if (ph.filesz == 0)
+			continue;
+		if (nvma >= NVMA)
+			goto bad;
+		vma[nvma].start = ph.vaddr;
+		vma[nvma].end = PGROUNDUP(ph.vaddr + ph.filesz);
+		vma[nvma].ip = ip;
+		vma[nvma].off = ph.off;
+		vma[nvma].filesz = ph.filesz;
+		vma[nvma].writable = (ph.flags & ELF_PROG_FLAG_WRITE) != 0;
+		nvma++;
 	}
-	iunlockput(ip);
+	iunlock(ip);
 	end_op();
-	ip = 0;
 
 	// Allocate two pages at the next page boundary.
 	// Make the first inaccessible.  Use the second as the user stack.
 	sz = PGROUNDUP(sz);
+	if (sz + 2 * PGSIZE > SHMBASE)
+		goto bad;
 	if ((sz = allocuvm(pgdir, sz, sz + 2 * PGSIZE)) == 0)
 		goto bad;
 	clearpteu(pgdir, (char *)(sz - 2 * PGSIZE));
@@ -89,24 +114,43 @@ int exec(char *path, char **argv) {
 	for (last = s = path; *s; s++)
 		if (*s == '/')
 			last = s + 1;
-	safestrcpy(curproc->name, last, sizeof(curproc->name));
+	safestrcpy(p->name, last, sizeof(p->name));
 
 	// Commit to the user image.
-	oldpgdir = curproc->pgdir;
-	curproc->pgdir = pgdir;
-	curproc->sz = sz;
-	curproc->tf->eip = elf.entry; // main
-	curproc->tf->esp = sp;
-	switchuvm(curproc);
-	freevm(oldpgdir);
+	if (vmcharge(p->sz, sz) < 0)
+		goto bad;
+	oldpgdir = p->pgdir;
+	p->pgdir = pgdir;
+	p->sz = sz;
+	p->tf->eip = elf.entry; // main
+	p->tf->esp = sp;
+	if (p == myproc())
+		switchuvm(p);
+	if (oldpgdir)
+		freevm(oldpgdir);
+	shmexit(p);
+	begin_op();
+	vmaput(p);
+	for (i = 0; i < nvma; i++) {
+		p->vma[i] = vma[i];
+		idup(ip);
+	}
+	iput(ip);
+	end_op();
 	return 0;
 
 bad:
 	if (pgdir)
 		freevm(pgdir);
 	if (ip) {
-		iunlockput(ip);
-		end_op();
+		if (holdingsleep(&ip->lock)) {
+			iunlockput(ip);
+			end_op();
+		} else {
+			begin_op();
+			iput(ip);
+			end_op();
+		}
 	}
 	return -1;
 }
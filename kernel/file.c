@@ -6,32 +6,33 @@
 #include "defs.h"
 #include "fs.h"
 #include "param.h"
+#include "slab.h"
 #include "sleeplock.h"
 #include "spinlock.h"
 #include "types.h"
 
 struct devsw devsw[NDEV];
+// File structures come from a slab cache, so the number of open files
+// is only limited by memory. The lock protects their reference counts.
 struct {
 	struct spinlock lock;
-	struct file file[NFILE];
+	struct slabcache cache;
 } ftable;
 
-void fileinit(void) { initlock(&ftable.lock, "ftable"); }
+void fileinit(void) {
+	initlock(&ftable.lock, "ftable");
+	slabinit(&ftable.cache, "file", sizeof(struct file));
+}
 
 // Allocate a file structure.
 struct file *filealloc(void) {
 	struct file *f;
 
-	acquire(&ftable.lock);
-	for (f = ftable.file; f < ftable.file + NFILE; f++) {
-		if (f->ref == 0) {
-			f->ref = 1;
-			release(&ftable.lock);
-			return f;
-		}
-	}
-	release(&ftable.lock);
-	return 0;
+	if ((f = slaballoc(&ftable.cache)) == 0)
+		return 0;
+	memset(f, 0, sizeof(*f));
+	f->ref = 1;
+	return f;
 }
 
 // Increment ref count for file f.
@@ -59,6 +60,7 @@ void fileclose(struct file *f) {
 	f->ref = 0;
 	f->type = FD_NONE;
 	release(&ftable.lock);
+	slabfree(&ftable.cache, f);
 
 	if (ff.type == FD_PIPE)
 		pipeclose(ff.pipe, ff.writable);
@@ -90,7 +92,7 @@ int fileread(struct file *f, char *addr, int n) {
 		return piperead(f->pipe, addr, n);
 	if (f->type == FD_INODE) {
 		ilock(f->ip);
-		if ((r = readi(f->ip, addr, f->off, n)) > 0)
+		if ((r = readira(f->ip, addr, f->off, n, &f->ra)) > 0)
 			f->off += r;
 		iunlock(f->ip);
 		return r;
@@ -98,6 +100,18 @@ int fileread(struct file *f, char *addr, int n) {
 	panic("fileread");
 }
 
+// How many bytes filewrite may write to ip in one transaction. Its
+// blocks must fit in MAXOPBLOCKS: the data blocks, one more when the
+// write is not block-aligned, the inode, the two bitmap blocks an
+// allocation can span, and the blocks mapping the data, which are the
+// extent block of an extent inode and up to three indirect blocks of
+// any other.
+static int writemax(struct inode *ip) {
+	int map = (ip->flags & I_EXTENT) ? 1 : 3;
+
+	return (MAXOPBLOCKS - 1 - 1 - 2 - map) * BSIZE;
+}
+
 // PAGEBREAK!
 // Write to file f.
 int filewrite(struct file *f, char *addr, int n) {
@@ -109,29 +123,24 @@ int filewrite(struct file *f, char *addr, int n) {
 		return pipewrite(f->pipe, addr, n);
 	if (f->type == FD_INODE) {
 		// write a few blocks at a time to avoid exceeding
-		// the maximum log transaction size, including
-		// i-node, indirect block, allocation blocks,
-		// and 2 blocks of slop for non-aligned writes.
+		// the maximum log transaction size; see writemax.
 		// this really belongs lower down, since writei()
 		// might be writing a device like the console.
-		int max = ((MAXOPBLOCKS - 1 - 1 - 2) / 2) * 512;
 		int i = 0;
 		while (i < n) {
 			int n1 = n - i;
-			if (n1 > max)
-				n1 = max;
 
 			begin_op();
 			ilock(f->ip);
+			if (n1 > writemax(f->ip))
+				n1 = writemax(f->ip);
 			if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
 				f->off += r;
 			iunlock(f->ip);
 			end_op();
 
-			if (r < 0)
-				break;
 			if (r != n1)
-				panic("short filewrite");
+				break; // error, or the file is out of extents
 			i += r;
 		}
 		return i == n ? n : -1;
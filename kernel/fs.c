@@ -38,7 +38,7 @@ struct {
 
 // Internal function prototypes
 static void itrunc(struct inode *);
-static uint bmap(struct inode *, uint);
+static uint bmap(struct inode *, uint, uint);
 static struct inode *iget(uint, uint);
 static void bfree(int, uint);
 static uint balloc(uint);
@@ -190,6 +190,47 @@ static uint balloc(uint dev) {
 	panic("balloc: out of blocks");
 }
 
+// Allocate block b if it is free. Returns 1 if it was.
+static int bclaim(uint dev, uint b) {
+	struct buf *bp;
+	int bi, m;
+
+	if (b >= (uint)sb.nblocks)
+		return 0;
+	bp = bread(dev, BMAPBLOCK(b, sb));
+	bi = b % BPB;
+	m = 1 << (bi % 8);
+	if (bp->data[bi / 8] & m) {
+		brelse(bp);
+		return 0;
+	}
+	bp->data[bi / 8] |= m;
+	log_write(bp);
+	brelse(bp);
+	bzero(dev, b);
+	return 1;
+}
+
+// Allocate up to want contiguous blocks, starting at goal if it is
+// free and wherever balloc finds a block otherwise. Returns the first
+// block and sets *got to how many were allocated.
+static uint ballocrun(uint dev, uint goal, uint want, uint *got) {
+	uint b, n;
+
+	if (goal == 0 || !bclaim(dev, goal))
+		goal = balloc(dev);
+	b = goal;
+	for (n = 1; n < want && bclaim(dev, b + 1); n++)
+		b++;
+	if (n > 1) {
+		acquire(&alloc_hint_lock);
+		last_alloc_hint = b;
+		release(&alloc_hint_lock);
+	}
+	*got = n;
+	return goal;
+}
+
 // Release a disk block back to free pool
 static void bfree(int dev, uint b) {
 	struct buf *bp;
@@ -210,6 +251,7 @@ static void bfree(int dev, uint b) {
 	bp->data[bi / 8] &= ~m;
 	log_write(bp);
 	brelse(bp);
+	log_revoke(b);
 }
 
 // Allocate new on-disk inode
@@ -224,6 +266,8 @@ struct inode *ialloc(uint dev, short type) {
 		if (dip->data.type == 0) { // Free inode found
 			memset(dip, 0, sizeof(*dip));
 			dip->data.type = type;
+			if (type == T_FILE || type == T_DIR)
+				dip->data.flags = I_EXTENT;
 			log_write(bp);
 			brelse(bp);
 			return iget(dev, inum);
@@ -250,6 +294,7 @@ void iupdate(struct inode *ip) {
 	dip->data.minor = ip->minor;
 	dip->data.nlink = ip->nlink;
 	dip->data.size = ip->size;
+	dip->data.flags = ip->flags;
 	memmove(dip->data.addrs, ip->addrs, sizeof(ip->addrs));
 
 	log_write(bp);
@@ -320,7 +365,10 @@ void ilock(struct inode *ip) {
 		ip->minor = dip->data.minor;
 		ip->nlink = dip->data.nlink;
 		ip->size = dip->data.size;
+		ip->flags = dip->data.flags;
 		memmove(ip->addrs, dip->data.addrs, sizeof(ip->addrs));
+		ip->xc.e.len = 0;
+		ip->pcached = pcachehas(ip->dev, ip->inum);
 
 		brelse(bp);
 		ip->valid = 1;
@@ -371,11 +419,125 @@ void iunlockput(struct inode *ip) {
 	iput(ip);
 }
 
-// Map file block to disk block (supports direct, single, double indirect)
-static uint bmap(struct inode *ip, uint bn) {
+// Read extent i of extent inode ip into *e.
+static void extread(struct inode *ip, int i, struct extent *e) {
+	struct buf *bp;
+
+	if (i < NIEXTENT) {
+		*e = ((struct extent *)ip->addrs)[i];
+		return;
+	}
+	bp = bread(ip->dev, ip->addrs[EXTBLOCK]);
+	*e = ((struct extent *)bp->data)[i - NIEXTENT];
+	brelse(bp);
+}
+
+// Set extent i of extent inode ip to *e. The caller updates the
+// inode itself.
+static void extwrite(struct inode *ip, int i, struct extent *e) {
+	struct buf *bp;
+
+	if (i < NIEXTENT) {
+		((struct extent *)ip->addrs)[i] = *e;
+		return;
+	}
+	if (ip->addrs[EXTBLOCK] == 0)
+		ip->addrs[EXTBLOCK] = balloc(ip->dev);
+	bp = bread(ip->dev, ip->addrs[EXTBLOCK]);
+	((struct extent *)bp->data)[i - NIEXTENT] = *e;
+	log_write(bp);
+	brelse(bp);
+}
+
+// Find block bn of extent inode ip. Returns 0 if it is past the
+// blocks allocated, and sets *nb to their number. The search starts
+// from the extent c found last, going back or forward from it, and
+// leaves c at the extent found, so a sequential reader looks up each
+// extent only once. Each reader of the extents keeps its own c.
+static uint extmap(struct inode *ip, uint bn, uint *nb,
+		   struct extcur *c) {
+	struct extent e;
+	uint first;
+	int i;
+
+	i = 0;
+	first = 0;
+	if (c->e.len > 0) {
+		if (bn >= c->first && bn < c->first + c->e.len)
+			return c->e.start + bn - c->first;
+		i = c->idx;
+		first = c->first;
+		while (bn < first && i > 0) {
+			extread(ip, --i, &e);
+			first -= e.len;
+		}
+	}
+	for (; i < ip->addrs[EXTCOUNT]; i++) {
+		extread(ip, i, &e);
+		if (bn < first + e.len) {
+			c->e = e;
+			c->first = first;
+			c->idx = i;
+			return e.start + bn - first;
+		}
+		first += e.len;
+	}
+	*nb = first;
+	return 0;
+}
+
+// Allocate block bn of extent inode ip, which must be the first past
+// its end, and up to want-1 blocks after it, as one run following the
+// last extent if the blocks there are free. Returns 0 if ip has no
+// room for another extent.
+static uint extalloc(struct inode *ip, uint bn, uint want) {
+	struct extent e;
+	uint got, nb, addr, goal;
+	int n;
+
+	if ((addr = extmap(ip, bn, &nb, &ip->xc)) != 0)
+		return addr;
+	if (bn != nb)
+		panic("extalloc: hole");
+	n = ip->addrs[EXTCOUNT];
+	goal = 0;
+	if (n > 0) {
+		extread(ip, n - 1, &e);
+		goal = e.start + e.len;
+	}
+	if (n == NIEXTENT + NXEXTENT) {
+		// No room for another extent: only the last one can grow.
+		if (!bclaim(ip->dev, goal))
+			return 0;
+		addr = goal;
+		got = 1;
+	} else {
+		addr = ballocrun(ip->dev, goal, want, &got);
+	}
+	if (n > 0 && addr == goal) {
+		e.len += got;
+		extwrite(ip, n - 1, &e);
+	} else {
+		e.start = addr;
+		e.len = got;
+		extwrite(ip, n, &e);
+		ip->addrs[EXTCOUNT] = n + 1;
+	}
+	iupdate(ip);
+	return addr;
+}
+
+// Map file block to disk block (supports direct, single, double
+// indirect, or extents), allocating it if need be. want is how many
+// blocks from bn on the caller is about to write, which an extent
+// inode allocates together.
+static uint bmap(struct inode *ip, uint bn, uint want) {
 	uint addr, *a;
 	struct buf *bp;
 
+	if (ip->flags & I_EXTENT)
+		return extalloc(ip, bn, want);
+
 	// Direct blocks
 	if (bn < NDIRECT) {
 		if ((addr = ip->addrs[bn]) == 0) {
@@ -434,11 +596,38 @@ static uint bmap(struct inode *ip, uint bn) {
 	panic("bmap: block number out of range");
 }
 
+// Free the blocks of extent inode ip.
+static void itruncext(struct inode *ip) {
+	struct extent e;
+	uint b;
+	int i;
+
+	for (i = 0; i < ip->addrs[EXTCOUNT]; i++) {
+		extread(ip, i, &e);
+		for (b = e.start; b < e.start + e.len; b++)
+			bfree(ip->dev, b);
+	}
+	if (ip->addrs[EXTBLOCK])
+		bfree(ip->dev, ip->addrs[EXTBLOCK]);
+	memset(ip->addrs, 0, sizeof(ip->addrs));
+	ip->xc.e.len = 0;
+}
+
 // Truncate inode (free all data blocks)
 static void itrunc(struct inode *ip) {
 	struct buf *bp, *bp2;
 	uint *a, *a2;
 
+	if (ip->pcached)
+		pcacheinval(ip);
+
+	if (ip->flags & I_EXTENT) {
+		itruncext(ip);
+		ip->size = 0;
+		iupdate(ip);
+		return;
+	}
+
 	// Free direct blocks
 	for (int i = 0; i < NDIRECT; i++) {
 		if (ip->addrs[i]) {
@@ -500,9 +689,77 @@ void stati(struct inode *ip, struct stat *st) {
 	st->size = ip->size;
 }
 
+// Like bmap, but never allocates: returns 0 for a block not on disk.
+// An extent inode's extents are looked up from c.
+static uint bmapped(struct inode *ip, uint bn, struct extcur *c) {
+	uint addr, nb;
+	struct buf *bp;
+
+	if (ip->flags & I_EXTENT)
+		return extmap(ip, bn, &nb, c);
+
+	if (bn < NDIRECT)
+		return ip->addrs[bn];
+	bn -= NDIRECT;
+
+	if (bn < NINDIRECT) {
+		if ((addr = ip->addrs[NDIRECT]) == 0)
+			return 0;
+		bp = bread(ip->dev, addr);
+		addr = ((uint *)bp->data)[bn];
+		brelse(bp);
+		return addr;
+	}
+	bn -= NINDIRECT;
+
+	if (bn < NDINDIRECT) {
+		if ((addr = ip->addrs[NDIRECT + 1]) == 0)
+			return 0;
+		bp = bread(ip->dev, addr);
+		addr = ((uint *)bp->data)[bn / NINDIRECT];
+		brelse(bp);
+		if (addr == 0)
+			return 0;
+		bp = bread(ip->dev, addr);
+		addr = ((uint *)bp->data)[bn % NINDIRECT];
+		brelse(bp);
+		return addr;
+	}
+	return 0;
+}
+
+// Start reading the blocks of ip that follow block bn, up to
+// NREADAHEAD of them and not past the end of the file, unless ra says
+// that was done already. readira calls this for sequential readers
+// before each block, so the disk works on the next blocks while the
+// current one is copied out.
+static void readahead(struct inode *ip, uint bn, struct rastate *ra) {
+	struct extcur c;
+	uint b, end, addr;
+
+	end = bn + 1 + NREADAHEAD;
+	if (end > (ip->size + BSIZE - 1) / BSIZE)
+		end = (ip->size + BSIZE - 1) / BSIZE;
+	b = ra->end > bn + 1 ? ra->end : bn + 1;
+	c = ip->xc; // leave readi's own lookups where they are
+	for (; b < end; b++)
+		if ((addr = bmapped(ip, b, &c)) != 0)
+			breadahead(ip->dev, addr);
+	if (end > ra->end)
+		ra->end = end;
+}
+
 // Read data from inode with overflow protection
 int readi(struct inode *ip, char *dst, uint off, uint n) {
+	return readira(ip, dst, off, n, 0);
+}
+
+// Like readi, for a reader that keeps its place in ra between calls:
+// sequential reads through ra get read-ahead. ra may be 0.
+int readira(struct inode *ip, char *dst, uint off, uint n,
+	    struct rastate *ra) {
 	uint tot, m;
+	int seq;
 	struct buf *bp;
 
 	if (ip->type == T_DEV) {
@@ -520,19 +777,30 @@ int readi(struct inode *ip, char *dst, uint off, uint n) {
 		n = ip->size - off;
 	}
 
+	// A read starting where the last one ended, or in the block it
+	// ended in, is sequential and gets read-ahead.
+	seq = ra != 0 &&
+	      (off / BSIZE == ra->pos || off / BSIZE + 1 == ra->pos);
+	if (ra != 0 && !seq)
+		ra->end = 0;
+
 	for (tot = 0; tot < n; tot += m, off += m, dst += m) {
-		bp = bread(ip->dev, bmap(ip, off / BSIZE));
+		if (seq)
+			readahead(ip, off / BSIZE, ra);
+		bp = bread(ip->dev, bmap(ip, off / BSIZE, 1));
 		m = MIN(n - tot, BSIZE - off % BSIZE);
 		memmove(dst, bp->data + off % BSIZE, m);
 		brelse(bp);
 	}
+	if (ra != 0 && n > 0)
+		ra->pos = (off - 1) / BSIZE + 1;
 
 	return n;
 }
 
 // Write data to inode with bounds checking
 int writei(struct inode *ip, char *src, uint off, uint n) {
-	uint tot, m;
+	uint tot, m, addr;
 	struct buf *bp;
 
 	if (ip->type == T_DEV) {
@@ -550,9 +818,18 @@ int writei(struct inode *ip, char *src, uint off, uint n) {
 	if (off + n > MAXFILE * BSIZE) {
 		return -1;
 	}
+	if (ip->pcached) {
+		pcacheinval(ip);
+	}
 
 	for (tot = 0; tot < n; tot += m, off += m, src += m) {
-		bp = bread(ip->dev, bmap(ip, off / BSIZE));
+		// Blocks this write covers from here on, for bmap to
+		// allocate in one run.
+		addr = bmap(ip, off / BSIZE,
+			    (off + n - tot - 1) / BSIZE - off / BSIZE + 1);
+		if (addr == 0)
+			break; // out of extents
+		bp = bread(ip->dev, addr);
 		m = MIN(n - tot, BSIZE - off % BSIZE);
 		memmove(bp->data + off % BSIZE, src, m);
 		log_write(bp);
@@ -560,12 +837,12 @@ int writei(struct inode *ip, char *src, uint off, uint n) {
 	}
 
 	// Update size if file grew
-	if (n > 0 && off > ip->size) {
+	if (tot > 0 && off > ip->size) {
 		ip->size = off;
 		iupdate(ip);
 	}
 
-	return n;
+	return tot;
 }
 
 // Directory name comparison
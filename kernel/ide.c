@@ -1,6 +1,8 @@
 #include "buf.h"
 #include "defs.h"
+#include "memlayout.h"
 #include "param.h"
+#include "pci.h"
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
@@ -18,10 +20,41 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4 // Read Multiple (Efisien untuk BSIZE > 512)
 #define IDE_CMD_WRMUL 0xc5 // Write Multiple
+#define IDE_CMD_SETMUL 0xc6 // Set Multiple Mode
+#define IDE_CMD_RDDMA 0xc8 // Read DMA
+#define IDE_CMD_WRDMA 0xca // Write DMA
+
+// PCI bus-master IDE (PIIX and compatibles): registers of the primary
+// channel, at idebm, and the physical region descriptors it reads.
+#define BM_CMD 0x0
+#define BM_STATUS 0x2
+#define BM_PRDT 0x4
+#define BM_START 0x1 // BM_CMD: run the transfer
+#define BM_READ 0x8  // BM_CMD: from the disk to memory
+#define BM_ERR 0x2   // BM_STATUS, write 1 to clear
+#define BM_INTR 0x4  // BM_STATUS, write 1 to clear
+#define PRD_EOT 0x8000
+
+struct prd {
+	uint addr;    // Physical address of a buffer
+	ushort len;   // Its length in bytes
+	ushort flags; // PRD_EOT on the last entry
+};
+
+#define BLOCK_SECTORS (BSIZE / SECTOR_SIZE)
+#define IDE_MULT 16 // Sectors per DRQ block in multiple mode
+#define IDE_MAXSECT 256 // Sectors one command can move
 
 static struct spinlock idelock;
-static struct buf *idequeue;
+static struct buf *idequeue;	 // Waiting, sorted by block number
+static struct buf *ideactive;	 // In the running command, via qnext
+static int ideactn;		 // Blocks in ideactive
+static int idexfer;		 // Sectors of it moved so far
+static struct buf *idecur;	 // Buffer the next sector goes to
 static int havedisk1;
+static int virtiodisk1;	 // Disk 1 is on virtio.c, not here
+static ushort idebm;	 // Bus-master registers, or 0 to use PIO
+static struct prd *ideprdt; // One entry per buffer of a command
 
 // Helper: Menunggu status disk dengan timeout agar kernel tidak freeze
 static int idewait(int checkerr) {
@@ -51,83 +84,209 @@ void ideinit(void) {
 		}
 	}
 	outb(0x1f6, 0xe0 | (0 << 4)); // Kembali ke Disk 0
+
+	// A virtio block device, if there is one, is the file system disk.
+	if (virtioinit()) {
+		virtiodisk1 = 1;
+		havedisk1 = 0;
+	}
+
+	// READ/WRITE MULTIPLE move IDE_MULT sectors per interrupt.
+	outb(0x3f6, 2); // No interrupt for these
+	for (int d = 0; d <= havedisk1; d++) {
+		outb(0x1f6, 0xe0 | (d << 4));
+		outb(0x1f2, IDE_MULT);
+		outb(0x1f7, IDE_CMD_SETMUL);
+		if (idewait(1) < 0)
+			panic("ideinit: multiple mode");
+	}
+	outb(0x1f6, 0xe0 | (0 << 4));
+
+	// Use DMA if the controller can be bus master; else stay with PIO.
+	struct pcidev pd;
+	if (pcifind(&pd, PCI_ANY, PCI_ANY, PCI_CLASS_STORAGE, PCI_SUB_IDE) &&
+	    (pd.progif & 0x80) && (pd.bar[4] & PCI_BAR_IO) &&
+	    (pd.bar[4] & ~3) != 0 && (ideprdt = (struct prd *)kalloc()) != 0) {
+		pciwrite(&pd, PCI_COMMAND,
+			 (pciread(&pd, PCI_COMMAND) & 0xFFFF) | PCI_CMD_IO |
+				 PCI_CMD_MASTER);
+		idebm = pd.bar[4] & ~3;
+		cprintf("ide: bus-master DMA at port 0x%x\n", idebm);
+	}
+}
+
+// Move the next DRQ block of the active command, IDE_MULT sectors or
+// what is left, between the disk and the buffers it belongs to.
+static void idepio(int write) {
+	int n, off;
+
+	n = ideactn * BLOCK_SECTORS - idexfer;
+	if (n > IDE_MULT)
+		n = IDE_MULT;
+	for (; n > 0; n--, idexfer++) {
+		off = idexfer % BLOCK_SECTORS * SECTOR_SIZE;
+		if (off == 0 && idexfer > 0)
+			idecur = idecur->qnext;
+		if (write)
+			outsl(0x1f0, idecur->data + off, SECTOR_SIZE / 4);
+		else
+			insl(0x1f0, idecur->data + off, SECTOR_SIZE / 4);
+	}
 }
 
-// Mulai operasi I/O pada buffer b
-static void idestart(struct buf *b) {
+// Start the command for ideactive: ideactn contiguous blocks, all
+// reads or all writes, in one READ/WRITE MULTIPLE. Caller holds
+// idelock.
+static void idestart(void) {
+	struct buf *b = ideactive, *p;
+	int i, write;
+
 	if (b == 0)
 		panic("idestart: null buf");
-	if (b->blockno >= FSSIZE)
+	if (b->blockno + ideactn > FSSIZE + SWAPSIZE)
 		panic("idestart: block out of range");
 
-	int sectors = BSIZE / SECTOR_SIZE; // BSIZE 2048 = 4 sektor
-	uint sector = b->blockno * sectors;
+	write = b->flags & B_DIRTY;
+	int sectors = ideactn * BLOCK_SECTORS; // BSIZE 2048 = 4 sektor
+	uint sector = b->blockno * BLOCK_SECTORS;
 
 	if (idewait(0) < 0) {
 		cprintf("ide: disk not ready for block %d\n", b->blockno);
 		return;
 	}
 
+	if (idebm) {
+		// One descriptor per buffer; the disk fills them in order.
+		for (i = 0, p = b; p; p = p->qnext, i++) {
+			ideprdt[i].addr = V2P(p->data);
+			ideprdt[i].len = BSIZE;
+			ideprdt[i].flags = p->qnext ? 0 : PRD_EOT;
+		}
+		outl(idebm + BM_PRDT, V2P(ideprdt));
+		outb(idebm + BM_CMD, write ? 0 : BM_READ);
+		outb(idebm + BM_STATUS,
+		     inb(idebm + BM_STATUS) | BM_ERR | BM_INTR);
+	}
+
 	// Konfigurasi Control Register
-	outb(0x3f6, 0);	      // Aktifkan interupsi
-	outb(0x1f2, sectors); // Jumlah sektor per blok
+	outb(0x3f6, 0);		     // Aktifkan interupsi
+	outb(0x1f2, sectors & 0xff); // Jumlah sektor (0 berarti 256)
 	outb(0x1f3, sector & 0xff);
 	outb(0x1f4, (sector >> 8) & 0xff);
 	outb(0x1f5, (sector >> 16) & 0xff);
 	outb(0x1f6, 0xe0 | ((b->dev & 1) << 4) | ((sector >> 24) & 0x0f));
 
-	if (b->flags & B_DIRTY) {
-		outb(0x1f7, (sectors > 1) ? IDE_CMD_WRMUL : IDE_CMD_WRITE);
-		outsl(0x1f0, b->data, BSIZE / 4); // Kirim data (PIO)
+	idexfer = 0;
+	idecur = b;
+	if (idebm) {
+		outb(0x1f7, write ? IDE_CMD_WRDMA : IDE_CMD_RDDMA);
+		outb(idebm + BM_CMD, BM_START | (write ? 0 : BM_READ));
+	} else if (write) {
+		outb(0x1f7, IDE_CMD_WRMUL);
+		idepio(1); // Kirim data (PIO)
 	} else {
-		outb(0x1f7, (sectors > 1) ? IDE_CMD_RDMUL : IDE_CMD_READ);
+		outb(0x1f7, IDE_CMD_RDMUL);
+	}
+}
+
+// Take the head of idequeue and the queued blocks that continue it,
+// up to IDE_MAXSECT sectors, as the next command, and start it.
+// Caller holds idelock.
+static void idenext(void) {
+	struct buf *b, *last;
+
+	if ((b = idequeue) == 0)
+		return;
+	ideactive = last = b;
+	ideactn = 1;
+	for (b = b->qnext; b && ideactn * BLOCK_SECTORS < IDE_MAXSECT;
+	     b = b->qnext) {
+		if (b->dev != last->dev || b->blockno != last->blockno + 1 ||
+		    (b->flags & B_DIRTY) != (last->flags & B_DIRTY))
+			break;
+		last = b;
+		ideactn++;
+	}
+	idequeue = last->qnext;
+	last->qnext = 0;
+	idestart();
+}
+
+// Mark b's transfer done, or failed if !ok, and pass b on to whoever
+// is waiting for it. Caller holds idelock.
+static void idefinish(struct buf *b, int ok) {
+	void (*done)(struct buf *);
+
+	if (ok)
+		b->flags |= B_VALID; // Selesai
+	else if (!(b->flags & B_DIRTY))
+		b->flags &= ~B_VALID; // Tandai gagal
+	b->flags &= ~B_DIRTY;
+	wakeup(b); // Bangunkan proses yang menunggu blok ini
+	if ((done = b->iodone) != 0) {
+		b->iodone = 0;
+		done(b);
 	}
 }
 
+// For other disk drivers: b, given to them by idesubmit, is done.
+void iofinish(struct buf *b, int ok) {
+	acquire(&idelock);
+	idefinish(b, ok);
+	release(&idelock);
+}
+
 void ideintr(void) {
-	struct buf *b;
+	struct buf *b, *next;
+	int write, ok;
+	uchar st;
 
 	acquire(&idelock);
-	if ((b = idequeue) == 0) {
+	if (ideactive == 0) {
 		release(&idelock);
 		return;
 	}
-	idequeue = b->qnext;
+	write = ideactive->flags & B_DIRTY;
 
 	// Baca data jika ini adalah operasi Read
-	if (!(b->flags & B_DIRTY)) {
-		if (idewait(1) >= 0) {
-			insl(0x1f0, b->data, BSIZE / 4); // Ambil data dari disk
-			b->flags |= B_VALID;
-		} else {
-			cprintf("ide: read error on block %d\n", b->blockno);
-			b->flags &= ~B_VALID; // Tandai gagal
+	ok = idewait(1) >= 0;
+	if (idebm) {
+		// The whole command is done; stop the engine.
+		st = inb(idebm + BM_STATUS);
+		outb(idebm + BM_CMD, 0);
+		outb(idebm + BM_STATUS, st);
+		if (st & BM_ERR)
+			ok = 0;
+	} else if (ok && idexfer < ideactn * BLOCK_SECTORS) {
+		// The disk wants or has the next DRQ block.
+		idepio(write);
+		if (write || idexfer < ideactn * BLOCK_SECTORS) {
+			release(&idelock);
+			return;
 		}
-	} else {
-		b->flags |= B_VALID; // Write selesai
 	}
+	if (!ok)
+		cprintf("ide: %s error on block %d\n", write ? "write" : "read",
+			ideactive->blockno);
 
-	b->flags &= ~B_DIRTY;
-	wakeup(b); // Bangunkan proses yang menunggu blok ini
+	// The command is over: finish every buffer in it.
+	for (b = ideactive; b; b = next) {
+		next = b->qnext;
+		idefinish(b, ok);
+	}
+	ideactive = 0;
+	ideactn = 0;
 
-	if (idequeue != 0)
-		idestart(idequeue);
+	idenext();
 
 	release(&idelock);
 }
 
-void iderw(struct buf *b) {
+// Add b to the queue, sorted by block number, and start the disk if
+// it was idle. Caller holds idelock.
+static void idequeueadd(struct buf *b) {
 	struct buf **pp;
 
-	if (!holdingsleep(&b->lock))
-		panic("iderw: buf not locked");
-	if ((b->flags & (B_VALID | B_DIRTY)) == B_VALID)
-		return;
-	if (b->dev != 0 && !havedisk1)
-		panic("iderw: disk 1 missing");
-
-	acquire(&idelock);
-
 	// PENINGKATAN: SSTF (Shortest Seek Time First) Sederhana
 	// Menyisipkan buffer ke antrean berdasarkan nomor blok terdekat
 	b->qnext = 0;
@@ -140,13 +299,60 @@ void iderw(struct buf *b) {
 	b->qnext = *pp;
 	*pp = b;
 
-	if (idequeue == b)
-		idestart(b);
+	if (ideactive == 0)
+		idenext();
+}
+
+// Start syncing b with disk and return without waiting: write it if
+// B_DIRTY is set, else read it if B_VALID is not. Caller holds
+// b->lock. When the transfer ends, the interrupt handler calls
+// b->iodone, if set, with idelock held; it must not sleep. A caller
+// that left iodone 0 waits for b with iowait instead. Any number of
+// buffers may be in flight at once.
+void idesubmit(struct buf *b) {
+	void (*done)(struct buf *);
 
-	// Tunggu sampai interupsi menandakan I/O selesai
-	while ((b->flags & (B_VALID | B_DIRTY)) != B_VALID) {
-		sleep(b, &idelock);
+	if (!holdingsleep(&b->lock))
+		panic("idesubmit: buf not locked");
+	if ((b->flags & (B_VALID | B_DIRTY)) == B_VALID) {
+		// Nothing to transfer.
+		if ((done = b->iodone) != 0) {
+			b->iodone = 0;
+			acquire(&idelock);
+			done(b);
+			release(&idelock);
+		}
+		return;
+	}
+	if (b->dev != 0 && virtiodisk1) {
+		virtiosubmit(b);
+		return;
 	}
+	if (b->dev != 0 && !havedisk1)
+		panic("idesubmit: disk 1 missing");
 
+	acquire(&idelock);
+	idequeueadd(b);
 	release(&idelock);
-}
\ No newline at end of file
+}
+
+// Wait for n buffers passed to idesubmit without an iodone to finish.
+void iowait(struct buf **bs, int n) {
+	int i;
+
+	acquire(&idelock);
+	for (i = 0; i < n; i++) {
+		// Tunggu sampai interupsi menandakan I/O selesai
+		while ((bs[i]->flags & (B_VALID | B_DIRTY)) != B_VALID)
+			sleep(bs[i], &idelock);
+	}
+	release(&idelock);
+}
+
+// Sync buf with disk.
+// If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
+// Else if B_VALID is not set, read buf from disk, set B_VALID.
+void iderw(struct buf *b) {
+	idesubmit(b);
+	iowait(&b, 1);
+}
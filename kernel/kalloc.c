@@ -1,9 +1,18 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, or with
+// kalloc_pages() blocks of 2^order physically contiguous pages.
+//
+// Free memory is kept by a buddy allocator: a free list per block
+// order, where a block of order n is 2^n pages aligned to its size.
+// Allocation splits a larger block if needed, and freeing merges a
+// block with its buddy, the other half of the block of the next order
+// up, whenever that is free too. Single pages mostly bypass it through
+// the per-CPU caches below.
 
 #include "defs.h"
 #include "memlayout.h"
+#include "memstat.h"
 #include "mmu.h"
 #include "param.h"
 #include "spinlock.h"
@@ -15,21 +24,64 @@ extern char end[]; // first address after kernel loaded from ELF file
 
 struct run {
 	struct run *next;
+	struct run *prev; // Only kept up to date on the buddy free lists
 };
 
-struct {
+// Per-CPU cache of free pages. kalloc() and kfree() normally touch
+// only the calling CPU's cache, whose lock is uncontended; pages move
+// between a cache and the buddy lists KCACHEBATCH at a time.
+struct kcache {
 	struct spinlock lock;
-	int use_lock;
 	struct run *freelist;
+	int nfree;
+};
+
+struct {
+	struct spinlock lock; // protects the buddy lists and order
+	int use_lock;
+	uint npages;			// Pages given to the allocator
+	struct run *free[MAXORDER + 1]; // Free blocks of each order
+	uint nblocks[MAXORDER + 1];
+	uchar *order; // Per page: 1 + order if a free block starts there
+	struct kcache cache[NCPU];
+	// Reference count of every physical page, indexed by page number.
+	// fork() shares user pages copy-on-write; kfree() only frees a
+	// page once its last reference is dropped. Sized for phystop and
+	// placed by kinit1() just past the kernel.
+	ushort *ref;
 } kmem;
 
+// Free pages that idle CPUs have already zeroed (see kzeroidle), so
+// kalloc_zeroed() can usually hand one out without a memset.
+struct {
+	struct spinlock lock;
+	struct run *freelist;
+	int nfree;
+} kzero;
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
 // 2. main() calls kinit2() with the rest of the physical pages
 // after installing a full page table that maps them on all cores.
+// Until kinit2() turns on use_lock, only the boot CPU runs and
+// kalloc()/kfree() use the buddy lists directly.
 void kinit1(void *vstart, void *vend) {
+	int i;
+	uint n;
+
+	n = phystop / PGSIZE * (sizeof(kmem.ref[0]) + sizeof(kmem.order[0]));
+	if ((char *)vstart + n > (char *)vend)
+		panic("kinit1: no room for page counts");
+	memset(vstart, 0, n);
+	kmem.ref = (ushort *)vstart;
+	kmem.order = (uchar *)(kmem.ref + phystop / PGSIZE);
+	vstart = (char *)vstart + n;
+
 	initlock(&kmem.lock, "kmem");
+	initlock(&kzero.lock, "kzero");
+	for (i = 0; i < NCPU; i++)
+		initlock(&kmem.cache[i].lock, "kcache");
 	kmem.use_lock = 0;
 	freerange(vstart, vend);
 }
@@ -42,9 +94,182 @@ void kinit2(void *vstart, void *vend) {
 void freerange(void *vstart, void *vend) {
 	char *p;
 	p = (char *)PGROUNDUP((uint)vstart);
-	for (; p + PGSIZE <= (char *)vend; p += PGSIZE)
+	for (; p + PGSIZE <= (char *)vend; p += PGSIZE) {
+		kmem.ref[V2P(p) / PGSIZE] = 1;
+		kmem.npages++;
 		kfree(p);
+	}
+}
+
+// Take the free block starting at page pn off its list.
+// Caller holds kmem.lock.
+static void buddyunlink(uint pn, int order) {
+	struct run *r;
+
+	r = (struct run *)P2V(pn * PGSIZE);
+	if (r->prev)
+		r->prev->next = r->next;
+	else
+		kmem.free[order] = r->next;
+	if (r->next)
+		r->next->prev = r->prev;
+	kmem.order[pn] = 0;
+	kmem.nblocks[order]--;
+}
+
+// Free the block of 2^order pages starting at page pn, merging it
+// with its buddy for as long as that is free. Caller holds kmem.lock.
+static void buddyput(uint pn, int order) {
+	struct run *r;
+	uint bn;
+
+	for (; order < MAXORDER; order++) {
+		bn = pn ^ (1 << order);
+		if (bn >= phystop / PGSIZE || kmem.order[bn] != order + 1)
+			break;
+		buddyunlink(bn, order);
+		pn &= ~(1 << order);
+	}
+	r = (struct run *)P2V(pn * PGSIZE);
+	r->prev = 0;
+	r->next = kmem.free[order];
+	if (r->next)
+		r->next->prev = r;
+	kmem.free[order] = r;
+	kmem.order[pn] = order + 1;
+	kmem.nblocks[order]++;
+}
+
+// Allocate a block of 2^order pages, splitting a larger one if there
+// is no free block of that order. Returns the first page number, or
+// -1 if no block is large enough. Caller holds kmem.lock.
+static int buddyget(int order) {
+	uint pn;
+	int o;
+
+	for (o = order; o <= MAXORDER && kmem.free[o] == 0; o++)
+		;
+	if (o > MAXORDER)
+		return -1;
+	pn = V2P(kmem.free[o]) / PGSIZE;
+	buddyunlink(pn, o);
+	// Give back the upper half at each split.
+	while (o > order) {
+		o--;
+		buddyput(pn + (1 << o), o);
+	}
+	return pn;
+}
+
+// Add a reference to the allocated page v, which is now mapped by
+// one more page table.
+void kincref(char *v) {
+	if ((uint)v % PGSIZE || v < end || V2P(v) >= phystop)
+		panic("kincref");
+	__sync_fetch_and_add(&kmem.ref[V2P(v) / PGSIZE], 1);
+}
+
+// Return the number of references to the allocated page v.
+int krefcount(char *v) { return kmem.ref[V2P(v) / PGSIZE]; }
+
+// Move up to n pages from the buddy lists into kc.
+// Caller holds kc->lock.
+static void krefill(struct kcache *kc, int n) {
+	struct run *r;
+	int pn;
+
+	acquire(&kmem.lock);
+	for (; n > 0 && (pn = buddyget(0)) >= 0; n--) {
+		r = (struct run *)P2V(pn * PGSIZE);
+		r->next = kc->freelist;
+		kc->freelist = r;
+		kc->nfree++;
+	}
+	release(&kmem.lock);
+}
+
+// Move n pages from kc back to the buddy lists.
+// Caller holds kc->lock.
+static void kdrain(struct kcache *kc, int n) {
+	struct run *r;
+
+	kc->nfree -= n;
+	acquire(&kmem.lock);
+	while (n-- > 0) {
+		r = kc->freelist;
+		kc->freelist = r->next;
+		buddyput(V2P(r) / PGSIZE, 0);
+	}
+	release(&kmem.lock);
+}
+
+// Return every page in the per-CPU caches to the buddy lists, so that
+// they can merge into larger blocks.
+static void kflush(void) {
+	struct kcache *kc;
+
+	for (kc = kmem.cache; kc < &kmem.cache[NCPU]; kc++) {
+		acquire(&kc->lock);
+		if (kc->nfree > 0)
+			kdrain(kc, kc->nfree);
+		release(&kc->lock);
+	}
 }
+
+// Rebalance when this CPU's cache and the buddy lists are both empty:
+// move half of the fullest other CPU's cache into kc. Called without
+// kc->lock held so that at most one cache lock is held at a time.
+static void ksteal(struct kcache *kc) {
+	struct kcache *victim, *c;
+	struct run *head, *tail;
+	int i, n;
+
+	victim = 0;
+	for (c = kmem.cache; c < &kmem.cache[NCPU]; c++)
+		if (c != kc && (victim == 0 || c->nfree > victim->nfree))
+			victim = c;
+	if (victim == 0)
+		return;
+
+	acquire(&victim->lock);
+	n = (victim->nfree + 1) / 2;
+	head = tail = victim->freelist;
+	for (i = 1; i < n; i++)
+		tail = tail->next;
+	if (n > 0) {
+		victim->freelist = tail->next;
+		victim->nfree -= n;
+	}
+	release(&victim->lock);
+	if (n == 0)
+		return;
+
+	acquire(&kc->lock);
+	tail->next = kc->freelist;
+	kc->freelist = head;
+	kc->nfree += n;
+	release(&kc->lock);
+}
+
+// Take a page from the pre-zeroed pool, or return 0 if it is empty.
+// The list link is the only non-zero word, so clear it on the way out.
+static char *kzeropop(void) {
+	struct run *r;
+
+	if (kzero.freelist == 0)
+		return 0;
+	acquire(&kzero.lock);
+	r = kzero.freelist;
+	if (r) {
+		kzero.freelist = r->next;
+		kzero.nfree--;
+		r->next = 0;
+		kmem.ref[V2P(r) / PGSIZE] = 1;
+	}
+	release(&kzero.lock);
+	return (char *)r;
+}
+
 // PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
@@ -52,20 +277,37 @@ void freerange(void *vstart, void *vend) {
 // initializing the allocator; see kinit above.)
 void kfree(char *v) {
 	struct run *r;
+	struct kcache *kc;
 
-	if ((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+	if ((uint)v % PGSIZE || v < end || V2P(v) >= phystop)
 		panic("kfree");
+	if (kmem.ref[V2P(v) / PGSIZE] == 0)
+		panic("kfree: page is free");
+
+	// A shared page stays allocated until its last reference goes.
+	if (__sync_sub_and_fetch(&kmem.ref[V2P(v) / PGSIZE], 1) != 0)
+		return;
 
+#ifdef KALLOC_DEBUG
 	// Fill with junk to catch dangling refs.
 	memset(v, 1, PGSIZE);
+#endif
 
-	if (kmem.use_lock)
-		acquire(&kmem.lock);
 	r = (struct run *)v;
-	r->next = kmem.freelist;
-	kmem.freelist = r;
-	if (kmem.use_lock)
-		release(&kmem.lock);
+	if (!kmem.use_lock) {
+		buddyput(V2P(v) / PGSIZE, 0);
+		return;
+	}
+
+	pushcli();
+	kc = &kmem.cache[cpuid()];
+	acquire(&kc->lock);
+	r->next = kc->freelist;
+	kc->freelist = r;
+	if (++kc->nfree >= KCACHEMAX)
+		kdrain(kc, KCACHEBATCH);
+	release(&kc->lock);
+	popcli();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -73,13 +315,143 @@ void kfree(char *v) {
 // Returns 0 if the memory cannot be allocated.
 char *kalloc(void) {
 	struct run *r;
+	struct kcache *kc;
+	int pn;
 
-	if (kmem.use_lock)
+	if (!kmem.use_lock) {
+		if ((pn = buddyget(0)) < 0)
+			return 0;
+		kmem.ref[pn] = 1;
+		return P2V(pn * PGSIZE);
+	}
+
+	pushcli();
+	kc = &kmem.cache[cpuid()];
+	acquire(&kc->lock);
+	if (kc->freelist == 0)
+		krefill(kc, KCACHEBATCH);
+	if (kc->freelist == 0) {
+		release(&kc->lock);
+		ksteal(kc);
+		acquire(&kc->lock);
+	}
+	r = kc->freelist;
+	if (r) {
+		kc->freelist = r->next;
+		kc->nfree--;
+	}
+	release(&kc->lock);
+	popcli();
+
+	// Last resort: the pre-zeroed pool is free memory too.
+	if (r == 0)
+		return kzeropop();
+	kmem.ref[V2P(r) / PGSIZE] = 1;
+	return (char *)r;
+}
+
+// Allocate 2^order physically contiguous pages, aligned to their
+// size, for callers such as DMA buffers that need more than a page.
+// Free them with kfree_pages(). Returns 0 if no free block is large
+// enough.
+char *kalloc_pages(int order) {
+	int i, pn;
+
+	if (order < 0 || order > MAXORDER)
+		panic("kalloc_pages");
+	if (order == 0)
+		return kalloc();
+
+	acquire(&kmem.lock);
+	pn = buddyget(order);
+	release(&kmem.lock);
+	if (pn < 0) {
+		// The pages may be sitting in the per-CPU caches.
+		kflush();
 		acquire(&kmem.lock);
-	r = kmem.freelist;
-	if (r)
-		kmem.freelist = r->next;
-	if (kmem.use_lock)
+		pn = buddyget(order);
 		release(&kmem.lock);
-	return (char *)r;
+		if (pn < 0)
+			return 0;
+	}
+	for (i = 0; i < (1 << order); i++)
+		kmem.ref[pn + i] = 1;
+	return P2V(pn * PGSIZE);
+}
+
+// Free a block that kalloc_pages(order) returned.
+void kfree_pages(char *v, int order) {
+	uint pn;
+	int i;
+
+	if (order == 0) {
+		kfree(v);
+		return;
+	}
+	pn = V2P(v) / PGSIZE;
+	if (order < 0 || order > MAXORDER || pn % (1 << order) ||
+	    v < end || V2P(v) + (PGSIZE << order) > phystop)
+		panic("kfree_pages");
+	for (i = 0; i < (1 << order); i++) {
+		if (kmem.ref[pn + i] != 1)
+			panic("kfree_pages: shared or free");
+		kmem.ref[pn + i] = 0;
+	}
+#ifdef KALLOC_DEBUG
+	memset(v, 1, PGSIZE << order);
+#endif
+	acquire(&kmem.lock);
+	buddyput(pn, order);
+	release(&kmem.lock);
+}
+
+// Fill in st with the state of the allocator, for the memstat()
+// system call. The free-page counts can be slightly off, since the
+// per-CPU caches are read without their locks.
+void kmemstat(struct memstat *st) {
+	struct kcache *kc;
+	int o;
+
+	memset(st, 0, sizeof(*st));
+	acquire(&kmem.lock);
+	st->npages = kmem.npages;
+	for (o = 0; o <= MAXORDER; o++) {
+		st->nblocks[o] = kmem.nblocks[o];
+		st->nfree += kmem.nblocks[o] << o;
+	}
+	release(&kmem.lock);
+	for (kc = kmem.cache; kc < &kmem.cache[NCPU]; kc++)
+		st->ncached += kc->nfree;
+	st->nzeroed = kzero.nfree;
+	st->nfree += st->ncached + st->nzeroed;
+}
+
+// Allocate one zero-filled page, preferably from the pool that idle
+// CPUs keep topped up. Returns 0 if the memory cannot be allocated.
+char *kalloc_zeroed(void) {
+	char *v;
+
+	if ((v = kzeropop()) != 0)
+		return v;
+	if ((v = kalloc()) != 0)
+		memset(v, 0, PGSIZE);
+	return v;
+}
+
+// Called by an idle CPU's scheduler loop: zero one free page and add
+// it to the pre-zeroed pool, until the pool holds KZEROMAX pages.
+void kzeroidle(void) {
+	struct run *r;
+
+	if (!kmem.use_lock || kzero.nfree >= KZEROMAX)
+		return;
+	if ((r = (struct run *)kalloc()) == 0)
+		return;
+	memset(r, 0, PGSIZE);
+
+	acquire(&kzero.lock);
+	r->next = kzero.freelist;
+	kzero.freelist = r;
+	kzero.nfree++;
+	release(&kzero.lock);
 }
@@ -9,74 +9,136 @@
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
-// any reasoning required about whether a commit might
-// write an uncommitted system call's updates to disk.
+// calls. Transactions are committed by the log thread (logthread),
+// not by the calls themselves: the open transaction gathers calls
+// until it has waited GROUPTICKS ticks, grown to GROUPPCT percent of
+// the log, or someone needs it on disk (fsync, a full log). The
+// thread then closes it to new calls, waits for the calls in it to
+// end, and copies its blocks into log buffers. Only that copy holds
+// up new calls; while the copies are written, the next transaction
+// is already open. So there are at most two: one committing and one
+// gathering.
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the log thread has made room.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
 //   header block, containing block #s for block A, B, C, ...
-//   block A
-//   block B
-//   block C
+//     and the log slot holding each of them
+//   slot 0
+//   slot 1
 //   ...
-// Log appends are synchronous.
+// Its size comes from the superblock, up to what one header block
+// can name (LOGMAX). Log appends and installs queue all their blocks
+// at once, so the disk can take them in its own order, and then wait
+// for them all.
+//
+// Committed blocks are not installed at their home locations right
+// away. They stay dirty in the buffer cache, and the header on disk
+// keeps naming them and their slots, so recovery can still install
+// them. A commit writes only the blocks of its own transaction, each
+// to a free slot, and its header names those slots along with the
+// older ones still committed; a block the transaction rewrote moves
+// to its new slot, and the old one is free again once the header is
+// on disk. A block rewritten by every transaction is thus written
+// home only once, and blocks left alone are not logged again. The
+// log thread installs the committed blocks (flush()) every
+// FLUSHTICKS ticks, when they fill LOGDIRTY percent of the log, when
+// the log has no room left, and for sync.
+// A flush keeps FS calls out until it is done, so the cached blocks
+// it writes are exactly the committed ones.
+//
+// A block the file system frees is revoked (log_revoke()): dropped
+// from the open transaction at once, and from the committed blocks by
+// the next commit, whose header no longer names it. Its cached buffer
+// is unpinned unwritten as soon as nothing names it, so the blocks of
+// a file created and removed between commits never reach the disk at
+// all, and freed blocks are not installed.
+// Writing the block again after it is reallocated cancels the revoke.
+
+#define LOGMAX ((BSIZE / sizeof(int) - 1) / 2) // Blocks one header names
 
 // Contents of the header block, used for both the on-disk header block
 // and to keep track in memory of logged block# before commit.
 struct logheader {
 	int n;
-	int block[LOGSIZE];
+	int block[LOGMAX];
+	int slot[LOGMAX]; // log slot holding block[i]
 };
 
 struct log {
 	struct spinlock lock;
 	int start;
-	int size;
+	int size;	 // usable log slots
 	int outstanding; // how many FS sys calls are executing.
-	int committing;	 // in commit(), please wait.
+	int frozen;	 // open transaction closed to new calls
+	int commitnow;	 // someone waits for the open transaction
+	int flushnow;	 // log full, sync, or many blocks uninstalled
+	uint opened;	 // number of the open transaction
+	uint ncommit;	 // transactions committed
+	uint nflush;	 // flushes done
+	uint opentick;	 // when the open transaction got its first block
+	uint flushtick;	 // when the last flush was done
 	int dev;
-	struct logheader lh;
+	struct logheader lh;	  // open transaction
+	struct logheader ck;	  // committed or committing, not installed
+	struct logheader rv;	  // revoked in the open transaction
+	struct logheader cm;	  // blocks commit() is logging
+	char used[LOGMAX];	  // slots the header names or commit fills
+	int hand;		  // where logslot() looks for a slot next
+	struct buf *bufs[LOGMAX]; // for the log thread's I/O
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
 
 void initlog(int dev) {
-	if (sizeof(struct logheader) >= BSIZE)
+	if (sizeof(struct logheader) > BSIZE)
 		panic("initlog: too big logheader");
 
 	struct superblock sb;
 	initlock(&log.lock, "log");
 	readsb(dev, &sb);
 	log.start = sb.logstart;
-	log.size = sb.nlog;
+	log.size = sb.nlog - 1;
+	if (log.size > LOGMAX)
+		log.size = LOGMAX;
+	// The cache must hold the pinned blocks and their log copies.
+	if (log.size > bcachesize() / 4)
+		log.size = bcachesize() / 4;
+	if (log.size < MAXOPBLOCKS)
+		panic("initlog: log too small");
 	log.dev = dev;
+	log.opened = 1;
 	recover_from_log();
 }
 
-// Copy committed blocks from log to their home location
+// Copy committed blocks from log to their home location.
+// All the writes are queued before waiting for any.
 static void install_trans(void) {
+	struct buf **dbufs = log.bufs;
 	int tail;
 
-	for (tail = 0; tail < log.lh.n; tail++) {
-		struct buf *lbuf =
-			bread(log.dev, log.start + tail + 1); // read log block
+	// During recovery the log blocks are not cached yet.
+	for (tail = 0; tail < log.ck.n; tail++)
+		breadahead(log.dev, log.start + log.ck.slot[tail] + 1);
+	for (tail = 0; tail < log.ck.n; tail++) {
+		int lb = log.start + log.ck.slot[tail] + 1;
+		struct buf *lbuf = bread(log.dev, lb); // read log block
 		struct buf *dbuf =
-			bread(log.dev, log.lh.block[tail]); // read dst
+			bread(log.dev, log.ck.block[tail]); // read dst
 		memmove(dbuf->data, lbuf->data, BSIZE);	    // copy block to dst
-		bwrite(dbuf);				    // write dst to disk
+		bstart(dbuf);				    // write dst to disk
 		brelse(lbuf);
-		brelse(dbuf);
+		dbufs[tail] = dbuf;
 	}
+	bwait(dbufs, log.ck.n);
+	for (tail = 0; tail < log.ck.n; tail++)
+		brelse(dbufs[tail]);
 }
 
 // Read the log header from disk into the in-memory log header
@@ -84,9 +146,14 @@ static void read_head(void) {
 	struct buf *buf = bread(log.dev, log.start);
 	struct logheader *lh = (struct logheader *)(buf->data);
 	int i;
-	log.lh.n = lh->n;
-	for (i = 0; i < log.lh.n; i++) {
-		log.lh.block[i] = lh->block[i];
+	log.ck.n = lh->n;
+	if (log.ck.n < 0 || log.ck.n > LOGMAX)
+		panic("read_head: bad log header");
+	for (i = 0; i < log.ck.n; i++) {
+		log.ck.block[i] = lh->block[i];
+		log.ck.slot[i] = lh->slot[i];
+		if (log.ck.slot[i] < 0 || log.ck.slot[i] >= LOGMAX)
+			panic("read_head: bad log slot");
 	}
 	brelse(buf);
 }
@@ -98,9 +165,10 @@ static void write_head(void) {
 	struct buf *buf = bread(log.dev, log.start);
 	struct logheader *hb = (struct logheader *)(buf->data);
 	int i;
-	hb->n = log.lh.n;
-	for (i = 0; i < log.lh.n; i++) {
-		hb->block[i] = log.lh.block[i];
+	hb->n = log.ck.n;
+	for (i = 0; i < log.ck.n; i++) {
+		hb->block[i] = log.ck.block[i];
+		hb->slot[i] = log.ck.slot[i];
 	}
 	bwrite(buf);
 	brelse(buf);
@@ -109,7 +177,7 @@ static void write_head(void) {
 static void recover_from_log(void) {
 	read_head();
 	install_trans(); // if committed, copy from log to disk
-	log.lh.n = 0;
+	log.ck.n = 0;
 	write_head(); // clear the log
 }
 
@@ -117,11 +185,14 @@ static void recover_from_log(void) {
 void begin_op(void) {
 	acquire(&log.lock);
 	while (1) {
-		if (log.committing) {
+		if (log.frozen) {
 			sleep(&log, &log.lock);
-		} else if (log.lh.n + (log.outstanding + 1) * MAXOPBLOCKS >
-			   LOGSIZE) {
-			// this op might exhaust log space; wait for commit.
+		} else if (log.ck.n + log.lh.n +
+				   (log.outstanding + 1) * MAXOPBLOCKS >
+			   log.size) {
+			// this op might exhaust log space; have the log
+			// thread commit and install what there is.
+			log.flushnow = 1;
 			sleep(&log, &log.lock);
 		} else {
 			log.outstanding += 1;
@@ -132,65 +203,236 @@ void begin_op(void) {
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
 void end_op(void) {
-	int do_commit = 0;
-
 	acquire(&log.lock);
 	log.outstanding -= 1;
-	if (log.committing)
-		panic("log.committing");
-	if (log.outstanding == 0) {
-		do_commit = 1;
-		log.committing = 1;
-	} else {
-		// begin_op() may be waiting for log space,
-		// and decrementing log.outstanding has decreased
-		// the amount of reserved space.
+	// The log thread may be waiting for the calls in the
+	// transaction to end, and begin_op() for log space.
+	wakeup(&log);
+	release(&log.lock);
+}
+
+// Copy the blocks commit() is logging from cache to log buffers,
+// which write_log() writes out. Called with the transaction frozen.
+static void copy_log(void) {
+	int tail;
+
+	for (tail = 0; tail < log.cm.n; tail++) {
+		int lb = log.start + log.cm.slot[tail] + 1;
+		struct buf *to = bgetblk(log.dev, lb); // log block
+		struct buf *from =
+			bread(log.dev, log.cm.block[tail]); // cache block
+		memmove(to->data, from->data, BSIZE);
+		brelse(from);
+		log.bufs[tail] = to;
+	}
+}
+
+// Is blockno in h? Returns its index, or h->n if not.
+static int logfind(struct logheader *h, int blockno) {
+	int i;
+
+	for (i = 0; i < h->n; i++)
+		if (h->block[i] == blockno)
+			break;
+	return i;
+}
+
+// Remove entry i from h, moving the last one into its place.
+static void logdel(struct logheader *h, int i) {
+	h->n--;
+	h->block[i] = h->block[h->n];
+	h->slot[i] = h->slot[h->n];
+}
+
+// Take a free log slot. Consecutive calls get consecutive slots
+// where they can, so the disk can merge the writes.
+static int logslot(void) {
+	int i, s;
+
+	for (i = 0; i < log.size; i++) {
+		s = (log.hand + i) % log.size;
+		if (!log.used[s]) {
+			log.used[s] = 1;
+			log.hand = s + 1;
+			return s;
+		}
+	}
+	panic("commit: no log room");
+}
+
+// Mark free every slot the header does not name.
+static void logslots(void) {
+	int i;
+
+	memset(log.used, 0, sizeof(log.used));
+	for (i = 0; i < log.ck.n; i++)
+		log.used[log.ck.slot[i]] = 1;
+}
+
+// Write the log buffers copy_log() filled.
+static void write_log(void) {
+	int tail;
+
+	for (tail = 0; tail < log.cm.n; tail++)
+		bstart(log.bufs[tail]); // write the log
+	bwait(log.bufs, log.cm.n);
+	for (tail = 0; tail < log.cm.n; tail++)
+		brelse(log.bufs[tail]);
+}
+
+// Close the open transaction to new calls and wait for the calls in
+// it to end. Caller holds log.lock.
+static void freeze(void) {
+	log.frozen = 1;
+	while (log.outstanding > 0)
+		sleep(&log, &log.lock);
+}
+
+// Give each of the frozen transaction's blocks a free log slot and
+// add them to the committed ones not yet installed, and copy them.
+// Then open the next transaction, unless the caller wants the log
+// kept frozen, and write the copies and the header. The slots the
+// header on disk names stay untouched until the new header replaces
+// it; begin_op() made sure the free ones suffice. Caller holds
+// log.lock, which is released while copying and writing.
+static void commit(int keepfrozen) {
+	int i, j, s;
+
+	for (i = 0; i < log.rv.n; i++) {
+		j = logfind(&log.ck, log.rv.block[i]);
+		if (j < log.ck.n)
+			logdel(&log.ck, j);
+	}
+	log.cm.n = 0;
+	for (i = 0; i < log.lh.n; i++) {
+		s = logslot();
+		log.cm.block[log.cm.n] = log.lh.block[i];
+		log.cm.slot[log.cm.n++] = s;
+		j = logfind(&log.ck, log.lh.block[i]);
+		if (j == log.ck.n)
+			log.ck.block[log.ck.n++] = log.lh.block[i];
+		log.ck.slot[j] = s; // an older copy's slot is freed below
+	}
+	log.lh.n = 0;
+	log.opened++;
+	release(&log.lock);
+
+	copy_log(); // Copy committed blocks from cache to log buffers
+	// Nothing names the revoked blocks any more; let them go.
+	for (i = 0; i < log.rv.n; i++)
+		bforget(log.dev, log.rv.block[i]);
+	log.rv.n = 0;
+	if (!keepfrozen) {
+		// The copies are taken; the next transaction may start.
+		acquire(&log.lock);
+		log.frozen = 0;
 		wakeup(&log);
+		release(&log.lock);
 	}
+	write_log();  // Write the copies to the log
+	write_head(); // Write header to disk -- the real commit
+	logslots();
+
+	acquire(&log.lock);
+	log.ncommit++;
+	if (log.ck.n * 100 > log.size * LOGDIRTY)
+		log.flushnow = 1;
+}
+
+// Install the committed blocks at their home locations, straight
+// from the cache, and empty the log. Caller holds log.lock and has
+// the log frozen with nothing open; the lock is released while
+// writing.
+static void flush(void) {
+	int i;
+
 	release(&log.lock);
+	for (i = 0; i < log.ck.n; i++) {
+		log.bufs[i] = bread(log.dev, log.ck.block[i]);
+		bstart(log.bufs[i]); // clears B_DIRTY: may be evicted again
+	}
+	bwait(log.bufs, log.ck.n);
+	for (i = 0; i < log.ck.n; i++)
+		brelse(log.bufs[i]);
+	log.ck.n = 0;
+	write_head(); // Erase the installed blocks from the log
+	logslots();
+	acquire(&log.lock);
+}
+
+// Is there anything for the log thread to do? Checked every tick.
+static int logwork(void) {
+	if (log.lh.n > 0 &&
+	    (log.commitnow || log.lh.n * 100 >= log.size * GROUPPCT ||
+	     ticks - log.opentick >= GROUPTICKS))
+		return 1;
+	if (log.flushnow)
+		return 1;
+	return log.ck.n > 0 && ticks - log.flushtick >= FLUSHTICKS;
+}
+
+// Kernel thread committing transactions and installing committed
+// blocks.
+void logthread(void) {
+	int doflush;
+
+	for (;;) {
+		acquire(&tickslock);
+		while (!logwork())
+			sleep(&ticks, &tickslock);
+		release(&tickslock);
 
-	if (do_commit) {
-		// call commit w/o holding locks, since not allowed
-		// to sleep with locks.
-		commit();
 		acquire(&log.lock);
-		log.committing = 0;
+		doflush = log.flushnow ||
+			  (log.ck.n > 0 && ticks - log.flushtick >= FLUSHTICKS);
+		freeze();
+		if (log.lh.n > 0)
+			commit(doflush);
+		log.commitnow = 0;
+		if (doflush) {
+			flush();
+			log.flushnow = 0;
+			log.flushtick = ticks;
+			log.nflush++;
+		}
+		log.frozen = 0;
 		wakeup(&log);
 		release(&log.lock);
 	}
 }
 
-// Copy modified blocks from cache to log.
-static void write_log(void) {
-	int tail;
+// Wait until every FS call that has ended is committed, so its
+// changes survive a crash.
+void logforce(void) {
+	uint want;
 
-	for (tail = 0; tail < log.lh.n; tail++) {
-		struct buf *to =
-			bread(log.dev, log.start + tail + 1); // log block
-		struct buf *from =
-			bread(log.dev, log.lh.block[tail]); // cache block
-		memmove(to->data, from->data, BSIZE);
-		bwrite(to); // write the log
-		brelse(from);
-		brelse(to);
+	acquire(&log.lock);
+	want = log.lh.n > 0 ? log.opened : log.opened - 1;
+	while (log.ncommit < want) {
+		log.commitnow = 1;
+		sleep(&log, &log.lock);
 	}
+	release(&log.lock);
 }
 
-static void commit() {
-	if (log.lh.n > 0) {
-		write_log();	 // Write modified blocks from cache to log
-		write_head();	 // Write header to disk -- the real commit
-		install_trans(); // Now install writes to home locations
-		log.lh.n = 0;
-		write_head(); // Erase the transaction from the log
+// Commit, then install, everything the FS calls that have ended
+// changed.
+void logflush(void) {
+	uint n;
+
+	acquire(&log.lock);
+	n = log.nflush;
+	while (log.nflush == n) {
+		log.flushnow = 1;
+		sleep(&log, &log.lock);
 	}
+	release(&log.lock);
 }
 
 // Caller has modified b->data and is done with the buffer.
 // Record the block number and pin in the cache with B_DIRTY.
-// commit()/write_log() will do the disk write.
+// The log thread will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -200,19 +442,46 @@ static void commit() {
 void log_write(struct buf *b) {
 	int i;
 
-	if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+	if (log.lh.n >= log.size)
 		panic("too big a transaction");
 	if (log.outstanding < 1)
 		panic("log_write outside of trans");
 
 	acquire(&log.lock);
-	for (i = 0; i < log.lh.n; i++) {
-		if (log.lh.block[i] == b->blockno) // log absorbtion
-			break;
-	}
+	i = logfind(&log.rv, b->blockno);
+	if (i < log.rv.n)
+		logdel(&log.rv, i); // reallocated
+	i = logfind(&log.lh, b->blockno); // log absorbtion
 	log.lh.block[i] = b->blockno;
-	if (i == log.lh.n)
+	if (i == log.lh.n) {
+		if (log.lh.n == 0)
+			log.opentick = ticks;
 		log.lh.n++;
+	}
 	b->flags |= B_DIRTY; // prevent eviction
 	release(&log.lock);
 }
+
+// The file system freed blockno; its contents no longer matter.
+// Called inside a transaction, which the freeing is part of.
+void log_revoke(uint blockno) {
+	int i, forget;
+
+	acquire(&log.lock);
+	forget = 0;
+	if ((i = logfind(&log.lh, blockno)) < log.lh.n) {
+		logdel(&log.lh, i);
+		forget = 1;
+	}
+	if (logfind(&log.ck, blockno) < log.ck.n) {
+		// The header on disk names it until the next commit.
+		if (logfind(&log.rv, blockno) == log.rv.n)
+			log.rv.block[log.rv.n++] = blockno;
+		forget = 0;
+	}
+	release(&log.lock);
+	// Only the open transaction had it: no log copy, and its home
+	// still holds the contents of the last committed state.
+	if (forget)
+		bforget(log.dev, blockno);
+}
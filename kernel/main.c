@@ -12,6 +12,7 @@ extern pde_t *kpgdir;
 extern char end[];
 
 int main(void) {
+	e820init();
 	kinit1(end, P2V(4 * 1024 * 1024));
 	kvmalloc();
 	mpinit();
@@ -24,18 +25,23 @@ int main(void) {
 	mouseinit();
 	pinit();
 	tvinit();
-	binit();
+	pcacheinit();
 	fileinit();
+	pipeinit();
+	shminit();
+	pciinit();
 	ideinit();
 	initGUI();
 	startothers();
-	kinit2(P2V(4 * 1024 * 1024), P2V(PHYSTOP));
+	kinit2(P2V(4 * 1024 * 1024), P2V(phystop));
+	binit(); // sized from all of memory
 	userinit();
 	mpmain();
 }
 
 static void mpenter(void) {
 	switchkvm();
+	kvmenable();
 	seginit();
 	lapicinit();
 	mpmain();
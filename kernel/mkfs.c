@@ -47,6 +47,7 @@ void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+uint xbmap(struct dinode *din, uint fbn);
 
 ushort xshort(ushort x) {
 	ushort y;
@@ -101,6 +102,8 @@ int main(int argc, char *argv[]) {
 	sb.inodestart = xint(2 + nlog);
 	sb.bmapstart = xint(2 + nlog + ninodeblocks);
 	sb.checksum = 0;
+	sb.swapstart = xint(FSSIZE);
+	sb.nswap = xint(SWAPSIZE);
 
 	printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap "
 	       "blocks %u) blocks %d total %d\n",
@@ -113,6 +116,9 @@ int main(int argc, char *argv[]) {
 
 	for (i = 0; i < FSSIZE; i++)
 		wsect(i, zeroes);
+	// The swap area needs no contents; writing its last block sizes
+	// the image.
+	wsect(FSSIZE + SWAPSIZE - 1, zeroes);
 
 	memset(buf, 0, sizeof(buf));
 	memmove(buf, &sb, sizeof(sb));
@@ -251,6 +257,7 @@ uint ialloc(ushort type) {
 
 	bzero(&din, sizeof(din));
 	din.data.type = xshort(type);
+	din.data.flags = xint(I_EXTENT);
 	din.data.nlink = xshort(1);
 	din.data.size = xint(0);
 	winode(inum, &din);
@@ -272,6 +279,53 @@ void balloc(int used) {
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Map block fbn of extent inode din, which is at most one past its
+// end, allocating it in that case. Files are written one after the
+// other, so each usually ends up a single extent.
+uint xbmap(struct dinode *din, uint fbn) {
+	struct extent *ie = (struct extent *)din->data.addrs;
+	struct extent xe[NXEXTENT], *e;
+	uint i, n, first, xb;
+
+	n = xint(din->data.addrs[EXTCOUNT]);
+	xb = xint(din->data.addrs[EXTBLOCK]);
+	if (xb != 0)
+		rsect(xb, (char *)xe);
+	e = 0;
+	first = 0;
+	for (i = 0; i < n; i++) {
+		e = i < NIEXTENT ? &ie[i] : &xe[i - NIEXTENT];
+		if (fbn < first + xint(e->len))
+			return xint(e->start) + fbn - first;
+		first += xint(e->len);
+	}
+
+	if (e != 0 && xint(e->start) + xint(e->len) == freeblock) {
+		e->len = xint(xint(e->len) + 1);
+	} else {
+		if (n == NIEXTENT + NXEXTENT) {
+			fprintf(stderr, "\nxbmap: out of extents\n");
+			exit(1);
+		}
+		if (n == NIEXTENT) {
+			xb = freeblock++;
+			din->data.addrs[EXTBLOCK] = xint(xb);
+			bzero(xe, sizeof(xe));
+		}
+		e = n < NIEXTENT ? &ie[n] : &xe[n - NIEXTENT];
+		e->start = xint(freeblock);
+		e->len = xint(1);
+		din->data.addrs[EXTCOUNT] = xint(n + 1);
+	}
+	if (xb != 0)
+		wsect(xb, (char *)xe);
+	if (freeblock >= (uint)(nmeta + nblocks)) {
+		fprintf(stderr, "\nOut of data blocks!\n");
+		exit(1);
+	}
+	return freeblock++;
+}
+
 void iappend(uint inum, void *xp, int n) {
 	char *p = (char *)xp;
 	uint fbn, off, n1;
@@ -294,7 +348,10 @@ void iappend(uint inum, void *xp, int n) {
 			exit(1);
 		}
 
-		if (fbn < NDIRECT) {
+		if (xint(din.data.flags) & I_EXTENT) {
+			x = xbmap(&din, fbn);
+
+		} else if (fbn < NDIRECT) {
 			if (xint(din.data.addrs[fbn]) == 0) {
 				if (freeblock >= (uint)(nmeta + nblocks)) {
 					fprintf(stderr,
@@ -0,0 +1,201 @@
+// Page cache.
+//
+// Holds whole pages of file data for demand-paged executables, so
+// that every process running the same program maps the same physical
+// pages for its text instead of reading and copying its own.
+//
+// A cached page is identified by the file (dev, inum), the file
+// offset it starts at and the number of file bytes it holds; the rest
+// of the page is zero. Program segments need not be page-aligned in
+// the file, so the offset is any byte offset, not a page number.
+//
+// The cache holds one reference to each of its pages (see kincref in
+// kalloc.c); every page table mapping the page holds another. Entries
+// are recycled with a clock sweep, which only drops the cache's
+// reference: processes still mapping the page keep it alive.
+//
+// Interface:
+// * pcacheget returns a page with a reference for the caller.
+// * pcacheinval drops every cached page of a file; writei and itrunc
+//     call it when ip->pcached says there may be some.
+// * pcachehas tells ilock whether a freshly loaded inode has pages
+//     cached from an earlier life in the inode cache.
+
+#include "defs.h"
+#include "file.h"
+#include "mmu.h"
+#include "param.h"
+#include "sleeplock.h"
+#include "spinlock.h"
+#include "types.h"
+
+#define NPCHASH 61
+
+struct pcpage {
+	uint dev;
+	uint inum;
+	uint off;	      // File offset of the first byte in the page
+	uint n;		      // Bytes of file data in the page
+	char *page;	      // Cached page, or 0 if the entry is free
+	int used;	      // Looked up since the clock hand last passed
+	struct pcpage *next; // Hash chain
+};
+
+struct {
+	struct spinlock lock;
+	struct pcpage entry[NPCACHE];
+	struct pcpage *hash[NPCHASH];
+	int hand;
+} pcache;
+
+static uint pchash(uint dev, uint inum, uint off) {
+	return (dev * 31 + inum * 17 + off / PGSIZE) % NPCHASH;
+}
+
+void pcacheinit(void) { initlock(&pcache.lock, "pcache"); }
+
+// Find the entry for the given key. Caller holds pcache.lock.
+static struct pcpage *pcfind(uint dev, uint inum, uint off, uint n) {
+	struct pcpage *e;
+
+	for (e = pcache.hash[pchash(dev, inum, off)]; e; e = e->next)
+		if (e->dev == dev && e->inum == inum && e->off == off &&
+		    e->n == n)
+			return e;
+	return 0;
+}
+
+// Take e off its hash chain and drop the cache's reference to its
+// page. Caller holds pcache.lock.
+static void pcdrop(struct pcpage *e) {
+	struct pcpage **pp;
+
+	for (pp = &pcache.hash[pchash(e->dev, e->inum, e->off)]; *pp != e;
+	     pp = &(*pp)->next)
+		;
+	*pp = e->next;
+	kfree(e->page);
+	e->page = 0;
+	e->next = 0;
+}
+
+// Pick an entry to reuse: a free one if the clock hand finds one,
+// otherwise the first one not looked up since the hand last passed.
+// Caller holds pcache.lock.
+static struct pcpage *pcvictim(void) {
+	struct pcpage *e;
+
+	for (;;) {
+		e = &pcache.entry[pcache.hand];
+		pcache.hand = (pcache.hand + 1) % NPCACHE;
+		if (e->page == 0)
+			return e;
+		if (!e->used) {
+			pcdrop(e);
+			return e;
+		}
+		e->used = 0;
+	}
+}
+
+// Add mem as the page holding n bytes of ip at off, unless another
+// process read it in first. Returns the cached page with a reference
+// for the caller; if that is not mem, the caller frees mem.
+static char *pcinsert(struct inode *ip, uint off, uint n, char *mem) {
+	struct pcpage *e;
+	uint h;
+
+	acquire(&pcache.lock);
+	if ((e = pcfind(ip->dev, ip->inum, off, n)) != 0) {
+		e->used = 1;
+		kincref(e->page);
+		release(&pcache.lock);
+		return e->page;
+	}
+	e = pcvictim();
+	e->dev = ip->dev;
+	e->inum = ip->inum;
+	e->off = off;
+	e->n = n;
+	e->page = mem;
+	e->used = 1;
+	h = pchash(e->dev, e->inum, e->off);
+	e->next = pcache.hash[h];
+	pcache.hash[h] = e;
+	kincref(mem);
+	ip->pcached = 1;
+	release(&pcache.lock);
+	return mem;
+}
+
+// Return a page holding the n bytes of ip's data at offset off,
+// zero-filled past them, with a reference for the caller. On a miss
+// the data is read in, which sleeps; if cansleep is 0 a miss returns
+// 0 instead. Also returns 0 if out of memory or ip is too short.
+char *pcacheget(struct inode *ip, uint off, uint n, int cansleep) {
+	struct pcpage *e;
+	char *mem, *page;
+	int locked;
+
+	if (n > PGSIZE)
+		panic("pcacheget");
+
+	acquire(&pcache.lock);
+	if ((e = pcfind(ip->dev, ip->inum, off, n)) != 0) {
+		e->used = 1;
+		kincref(e->page);
+		release(&pcache.lock);
+		return e->page;
+	}
+	release(&pcache.lock);
+
+	if (!cansleep)
+		return 0;
+	if ((mem = kalloc_zeroed()) == 0)
+		return 0;
+	// A system call touching user memory may already hold ip's lock.
+	locked = holdingsleep(&ip->lock);
+	if (!locked)
+		ilock(ip);
+	if (readi(ip, mem, off, n) != n) {
+		if (!locked)
+			iunlock(ip);
+		kfree(mem);
+		return 0;
+	}
+	page = pcinsert(ip, off, n, mem);
+	if (!locked)
+		iunlock(ip);
+	if (page != mem)
+		kfree(mem);
+	return page;
+}
+
+// Drop every cached page of ip, whose contents are about to change.
+// Caller holds ip->lock.
+void pcacheinval(struct inode *ip) {
+	struct pcpage *e;
+
+	acquire(&pcache.lock);
+	for (e = pcache.entry; e < &pcache.entry[NPCACHE]; e++)
+		if (e->page && e->dev == ip->dev && e->inum == ip->inum)
+			pcdrop(e);
+	ip->pcached = 0;
+	release(&pcache.lock);
+}
+
+// Does the cache hold any page of file (dev, inum)?
+int pcachehas(uint dev, uint inum) {
+	struct pcpage *e;
+	int r;
+
+	r = 0;
+	acquire(&pcache.lock);
+	for (e = pcache.entry; e < &pcache.entry[NPCACHE]; e++)
+		if (e->page && e->dev == dev && e->inum == inum) {
+			r = 1;
+			break;
+		}
+	release(&pcache.lock);
+	return r;
+}
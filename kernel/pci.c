@@ -0,0 +1,92 @@
+// PCI configuration space.
+//
+// Drivers look up their device with pcifind, which scans every
+// function on every bus through configuration mechanism #1 (ports
+// 0xCF8 and 0xCFC), and then read and write its registers with
+// pciread and pciwrite. The BIOS has already assigned base addresses
+// and interrupt lines; nothing is reassigned here.
+
+#include "defs.h"
+#include "pci.h"
+#include "spinlock.h"
+#include "types.h"
+#include "x86.h"
+
+#define PCI_ADDR 0xCF8
+#define PCI_DATA 0xCFC
+
+static struct spinlock pcilock;
+
+void pciinit(void) { initlock(&pcilock, "pci"); }
+
+static uint pciconfread(int bus, int dev, int func, int off) {
+	uint v;
+
+	acquire(&pcilock);
+	outl(PCI_ADDR, 0x80000000 | bus << 16 | dev << 11 | func << 8 |
+			       (off & 0xFC));
+	v = inl(PCI_DATA);
+	release(&pcilock);
+	return v;
+}
+
+uint pciread(struct pcidev *d, int off) {
+	return pciconfread(d->bus, d->dev, d->func, off);
+}
+
+void pciwrite(struct pcidev *d, int off, uint v) {
+	acquire(&pcilock);
+	outl(PCI_ADDR, 0x80000000 | d->bus << 16 | d->dev << 11 |
+			       d->func << 8 | (off & 0xFC));
+	outl(PCI_DATA, v);
+	release(&pcilock);
+}
+
+static int match(int want, uint have) {
+	return want == PCI_ANY || want == have;
+}
+
+// Find the first function matching the given vendor, device, class
+// and subclass, any of which may be PCI_ANY, and fill in *d.
+// Returns 0 if there is none.
+int pcifind(struct pcidev *d, int vendor, int device, int class,
+	    int subclass) {
+	int bus, dev, func, nfunc, i;
+	uint id, cl;
+
+	for (bus = 0; bus < 256; bus++) {
+		for (dev = 0; dev < 32; dev++) {
+			nfunc = 1;
+			for (func = 0; func < nfunc; func++) {
+				id = pciconfread(bus, dev, func, PCI_ID);
+				if ((id & 0xFFFF) == 0xFFFF)
+					continue;
+				// Header type bit 7: a multi-function device
+				if (func == 0 &&
+				    (pciconfread(bus, dev, 0, 0x0C) & 0x800000))
+					nfunc = 8;
+				cl = pciconfread(bus, dev, func, PCI_CLASS);
+				if (match(vendor, id & 0xFFFF) &&
+				    match(device, id >> 16) &&
+				    match(class, cl >> 24) &&
+				    match(subclass, (cl >> 16) & 0xFF))
+					goto found;
+			}
+		}
+	}
+	return 0;
+
+found:
+	d->bus = bus;
+	d->dev = dev;
+	d->func = func;
+	d->vendor = id & 0xFFFF;
+	d->device = id >> 16;
+	d->class = cl >> 24;
+	d->subclass = (cl >> 16) & 0xFF;
+	d->progif = (cl >> 8) & 0xFF;
+	for (i = 0; i < 6; i++)
+		d->bar[i] = pciread(d, PCI_BAR0 + 4 * i);
+	d->irq = pciread(d, PCI_INTLINE) & 0xFF;
+	return 1;
+}
@@ -4,6 +4,7 @@
 #include "mmu.h"
 #include "param.h"
 #include "proc.h"
+#include "slab.h"
 #include "sleeplock.h"
 #include "spinlock.h"
 #include "types.h"
@@ -19,6 +20,10 @@ struct pipe {
 	int writeopen; // write fd is still open
 };
 
+static struct slabcache pipecache;
+
+void pipeinit(void) { slabinit(&pipecache, "pipe", sizeof(struct pipe)); }
+
 int pipealloc(struct file **f0, struct file **f1) {
 	struct pipe *p;
 
@@ -26,7 +31,7 @@ int pipealloc(struct file **f0, struct file **f1) {
 	*f0 = *f1 = 0;
 	if ((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
 		goto bad;
-	if ((p = (struct pipe *)kalloc()) == 0)
+	if ((p = (struct pipe *)slaballoc(&pipecache)) == 0)
 		goto bad;
 	p->readopen = 1;
 	p->writeopen = 1;
@@ -46,7 +51,7 @@ int pipealloc(struct file **f0, struct file **f1) {
 	// PAGEBREAK: 20
 bad:
 	if (p)
-		kfree((char *)p);
+		slabfree(&pipecache, p);
 	if (*f0)
 		fileclose(*f0);
 	if (*f1)
@@ -65,7 +70,7 @@ void pipeclose(struct pipe *p, int writable) {
 	}
 	if (p->readopen == 0 && p->writeopen == 0) {
 		release(&p->lock);
-		kfree((char *)p);
+		slabfree(&pipecache, p);
 	} else
 		release(&p->lock);
 }
@@ -26,32 +26,25 @@ void pinit(void) { initlock(&ptable.lock, "ptable"); }
 int cpuid() { return mycpu() - cpus; }
 
 // Must be called with interrupts disabled to avoid the caller being
-// rescheduled between reading lapicid and running through the loop.
+// rescheduled onto another cpu while using the result.
+// seginit() points %gs at this cpu's struct cpu, so this is a
+// single load rather than a lapicid() read and a scan of cpus[].
 struct cpu *mycpu(void) {
-	int apicid, i;
+	struct cpu *c;
 
 	if (readeflags() & FL_IF)
 		panic("mycpu called with interrupts enabled\n");
 
-	apicid = lapicid();
-	// APIC IDs are not guaranteed to be contiguous. Maybe we should have
-	// a reverse map, or reserve a register to store &cpus[i].
-	for (i = 0; i < ncpu; ++i) {
-		if (cpus[i].apicid == apicid)
-			return &cpus[i];
-	}
-	panic("unknown apicid\n");
+	asm volatile("movl %%gs:0, %0" : "=r"(c));
+	return c;
 }
 
-// Disable interrupts so that we are not rescheduled
-// while reading proc from the cpu structure
+// Reading %gs:4 is a single instruction, so it cannot be split by a
+// reschedule and needs no pushcli/popcli around it.
 struct proc *myproc(void) {
-	struct cpu *c;
 	struct proc *p;
-	pushcli();
-	c = mycpu();
-	p = c->proc;
-	popcli();
+
+	asm volatile("movl %%gs:4, %0" : "=r"(p));
 	return p;
 }
 
@@ -115,6 +108,7 @@ void userinit(void) {
 	if ((p->pgdir = setupkvm()) == 0)
 		panic("userinit: out of memory?");
 	inituvm(p->pgdir, _binary_initcode_start, (int)_binary_initcode_size);
+	vmcharge(0, PGSIZE);
 	p->sz = PGSIZE;
 	memset(p->tf, 0, sizeof(*p->tf));
 	p->tf->cs = (SEG_UCODE << 3) | DPL_USER;
@@ -140,20 +134,41 @@ void userinit(void) {
 }
 
 // Grow current process's memory by n bytes.
+// Growing only reserves address space: pages are allocated and
+// zeroed on first touch (see pagefault in vm.c).
 // Return 0 on success, -1 on failure.
 int growproc(int n) {
-	uint sz;
+	uint sz, newsz;
+	int i;
+	struct vma *v;
 	struct proc *curproc = myproc();
 
 	sz = curproc->sz;
+	newsz = sz + n;
 	if (n > 0) {
-		if ((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+		if (newsz < sz || newsz > vmamapfloor(curproc))
+			return -1;
+		if (vmcharge(sz, newsz) < 0)
 			return -1;
 	} else if (n < 0) {
-		if ((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
+		if (newsz > sz)
+			return -1;
+		if ((newsz = deallocuvm(curproc->pgdir, sz, newsz)) == 0)
 			return -1;
+		vmcharge(sz, newsz);
+		// Memory grown back later must read as zeros, not as
+		// the file data it once held.
+		for (i = 0; i < NVMA; i++) {
+			v = &curproc->vma[i];
+			if (v->start >= sz) // mmap region
+				continue;
+			if (v->end > PGROUNDUP(newsz))
+				v->end = PGROUNDUP(newsz);
+			if (v->start > v->end)
+				v->start = v->end;
+		}
 	}
-	curproc->sz = sz;
+	curproc->sz = newsz;
 	switchuvm(curproc);
 	return 0;
 }
@@ -172,7 +187,24 @@ int fork(void) {
 	}
 
 	// Copy process state from proc.
-	if ((np->pgdir = copyuvm(curproc->pgdir, curproc->sz)) == 0) {
+	if (vmcharge(0, curproc->sz) < 0) {
+		kfree(np->kstack);
+		np->kstack = 0;
+		np->state = UNUSED;
+		return -1;
+	}
+	// Page tables for the copy may have to come from swapping.
+	if ((np->pgdir = copyuvm(curproc)) == 0 &&
+	    (swapout(SWAPBATCH) == 0 || (np->pgdir = copyuvm(curproc)) == 0)) {
+		vmcharge(curproc->sz, 0);
+		kfree(np->kstack);
+		np->kstack = 0;
+		np->state = UNUSED;
+		return -1;
+	}
+	if (shmfork(np, curproc) < 0) {
+		freevm(np->pgdir);
+		vmcharge(curproc->sz, 0);
 		kfree(np->kstack);
 		np->kstack = 0;
 		np->state = UNUSED;
@@ -189,6 +221,7 @@ int fork(void) {
 		if (curproc->ofile[i])
 			np->ofile[i] = filedup(curproc->ofile[i]);
 	np->cwd = idup(curproc->cwd);
+	vmadup(np, curproc);
 
 	safestrcpy(np->name, curproc->name, sizeof(curproc->name));
 
@@ -203,6 +236,82 @@ int fork(void) {
 	return pid;
 }
 
+// Create a child running the program at path with arguments argv, as
+// fork followed by exec in the child would, but without copying the
+// caller's memory only to throw the copy away. The child's descriptors
+// 0, 1 and 2 are the caller's fd[0], fd[1] and fd[2], left closed if
+// negative; it gets no others. Returns the child's pid, or -1.
+int spawn(char *path, char **argv, int *fd) {
+	int i, pid;
+	struct proc *np;
+	struct proc *curproc = myproc();
+
+	if ((np = allocproc()) == 0)
+		return -1;
+	np->pgdir = 0;
+	np->sz = 0;
+	*np->tf = *curproc->tf;
+	if (execproc(np, path, argv) < 0) {
+		kfree(np->kstack);
+		np->kstack = 0;
+		np->state = UNUSED;
+		return -1;
+	}
+	np->parent = curproc;
+	for (i = 0; i < 3; i++)
+		if (fd[i] >= 0 && fd[i] < NOFILE && curproc->ofile[fd[i]])
+			np->ofile[i] = filedup(curproc->ofile[fd[i]]);
+	np->cwd = idup(curproc->cwd);
+
+	pid = np->pid;
+
+	acquire(&ptable.lock);
+
+	np->state = RUNNABLE;
+
+	release(&ptable.lock);
+
+	return pid;
+}
+
+// A kernel thread's first scheduling swtches here. kthread left the
+// thread's body in the trap frame, which a kernel thread has no
+// other use for.
+static void kthreadret(void) {
+	void (*fn)(void);
+
+	// Still holding ptable.lock from scheduler.
+	release(&ptable.lock);
+	fn = (void (*)(void))myproc()->tf->eip;
+	fn();
+	panic("kthread returned");
+}
+
+// Start a kernel thread running fn, which must not return. It has a
+// page table with only the kernel's mappings. Returns its pid, or -1.
+int kthread(char *name, void (*fn)(void)) {
+	struct proc *np;
+
+	if ((np = allocproc()) == 0)
+		return -1;
+	if ((np->pgdir = setupkvm()) == 0) {
+		kfree(np->kstack);
+		np->kstack = 0;
+		np->state = UNUSED;
+		return -1;
+	}
+	np->sz = 0;
+	np->tf->eip = (uint)fn;
+	np->context->eip = (uint)kthreadret;
+	safestrcpy(np->name, name, sizeof(np->name));
+
+	acquire(&ptable.lock);
+	np->state = RUNNABLE;
+	release(&ptable.lock);
+
+	return np->pid;
+}
+
 // Exit the current process.  Does not return.
 // An exited process remains in the zombie state
 // until its parent calls wait() to find out it exited.
@@ -224,7 +333,10 @@ void exit(void) {
 
 	begin_op();
 	iput(curproc->cwd);
+	vmaput(curproc);
 	end_op();
+	shmexit(curproc);
+	shmdisown(curproc);
 	curproc->cwd = 0;
 
 	acquire(&ptable.lock);
@@ -268,6 +380,7 @@ int wait(void) {
 				kfree(p->kstack);
 				p->kstack = 0;
 				freevm(p->pgdir);
+				vmcharge(p->sz, 0);
 				p->pid = 0;
 				p->parent = 0;
 				p->name[0] = 0;
@@ -300,6 +413,7 @@ int wait(void) {
 void scheduler(void) {
 	struct proc *p;
 	struct cpu *c = mycpu();
+	int ran;
 	c->proc = 0;
 
 	for (;;) {
@@ -307,10 +421,12 @@ void scheduler(void) {
 		sti();
 
 		// Loop over process table looking for process to run.
+		ran = 0;
 		acquire(&ptable.lock);
 		for (p = ptable.proc; p < &ptable.proc[NPROC]; p++) {
 			if (p->state != RUNNABLE)
 				continue;
+			ran = 1;
 
 			// Switch to chosen process.  It is the process's job
 			// to release ptable.lock and then reacquire it
@@ -328,6 +444,10 @@ void scheduler(void) {
 			c->proc = 0;
 		}
 		release(&ptable.lock);
+
+		// Nothing to run: spend the idle time pre-zeroing pages.
+		if (!ran)
+			kzeroidle();
 	}
 }
 
@@ -377,6 +497,8 @@ void forkret(void) {
 		first = 0;
 		iinit(ROOTDEV);
 		initlog(ROOTDEV);
+		swapinit(ROOTDEV);
+		kthread("log", logthread);
 	}
 
 	// Return to "caller", actually trapret (see allocproc).
@@ -458,6 +580,16 @@ int kill(int pid) {
 	return -1;
 }
 
+// Lock the process table and return it, for the swap clock: with the
+// lock held, a process that is not running cannot start, so its page
+// table can be changed under it.
+struct proc *proclock(void) {
+	acquire(&ptable.lock);
+	return ptable.proc;
+}
+
+void procunlock(void) { release(&ptable.lock); }
+
 // PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
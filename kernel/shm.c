@@ -0,0 +1,214 @@
+// Shared memory segments.
+//
+// A segment is a set of zero-filled pages that any number of
+// processes can map at once, named by a key so that unrelated
+// processes can find it. shmget() returns the id of the segment with
+// a key, creating it if needed; key 0 always creates a new one.
+// shmat() maps a segment into the calling process and shmdt() unmaps
+// it again.
+//
+// A process has NSHMAT attach slots at the top of user space, slot i
+// at SHMBASE + i*SHMMAX, above anything sbrk can reach. Attachments
+// are inherited by fork and dropped by exec and exit.
+//
+// Every page table mapping a page holds a reference to it (kincref),
+// and the segment holds one more. A segment goes away when its last
+// attachment is dropped; its pages are freed once no page table
+// maps them any more. A segment nothing has attached yet belongs to
+// the process that created it, and goes away when that process exits
+// unless something has attached it by then.
+
+#include "defs.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "param.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "types.h"
+
+struct shmseg {
+	int key;
+	int npages;
+	char **pages; // Page holding the segment's page list, 0 if unused
+	int nattach;  // Attachments in all processes
+	struct proc *creator; // Process that made it, while it runs
+};
+
+struct {
+	struct spinlock lock;
+	struct shmseg seg[NSHM];
+} shmtab;
+
+void shminit(void) { initlock(&shmtab.lock, "shmtab"); }
+
+// Free the pages of segment s. Caller holds shmtab.lock.
+static void shmfree(struct shmseg *s) {
+	int i;
+
+	for (i = 0; i < s->npages; i++)
+		kfree(s->pages[i]);
+	kfree((char *)s->pages);
+	s->pages = 0;
+}
+
+// Drop one attachment of s.
+static void shmput(struct shmseg *s) {
+	acquire(&shmtab.lock);
+	if (--s->nattach == 0)
+		shmfree(s);
+	release(&shmtab.lock);
+}
+
+// Return the id of the segment with the given key, creating it with
+// size bytes if there is none. Returns -1 if an existing segment is
+// smaller than size, or no segment can be created.
+int shmget(int key, uint size) {
+	struct shmseg *s;
+	int i;
+
+	if (size == 0 || size > SHMMAX)
+		return -1;
+	acquire(&shmtab.lock);
+	if (key != 0) {
+		for (s = shmtab.seg; s < &shmtab.seg[NSHM]; s++) {
+			if (s->pages && s->key == key) {
+				release(&shmtab.lock);
+				if (size > s->npages * PGSIZE)
+					return -1;
+				return s - shmtab.seg;
+			}
+		}
+	}
+	for (s = shmtab.seg; s < &shmtab.seg[NSHM]; s++)
+		if (s->pages == 0)
+			break;
+	if (s == &shmtab.seg[NSHM] || (s->pages = (char **)kalloc()) == 0) {
+		release(&shmtab.lock);
+		return -1;
+	}
+	s->key = key;
+	s->npages = PGROUNDUP(size) / PGSIZE;
+	s->nattach = 0;
+	s->creator = myproc();
+	for (i = 0; i < s->npages; i++) {
+		if ((s->pages[i] = kalloc_zeroed()) == 0) {
+			s->npages = i;
+			shmfree(s);
+			release(&shmtab.lock);
+			return -1;
+		}
+	}
+	release(&shmtab.lock);
+	return s - shmtab.seg;
+}
+
+// Map segment s into p's free attach slot i.
+// Caller holds shmtab.lock.
+static int shmmap(struct proc *p, int i, struct shmseg *s) {
+	if (mapshared(p->pgdir, SHMBASE + i * SHMMAX, s->pages, s->npages) < 0)
+		return -1;
+	s->nattach++;
+	p->shm[i] = s;
+	return 0;
+}
+
+// Attach segment id to the current process.
+// Returns the address it is mapped at, or -1.
+int shmat(int id) {
+	struct proc *curproc = myproc();
+	struct shmseg *s;
+	int i;
+
+	if (id < 0 || id >= NSHM)
+		return -1;
+	for (i = 0; i < NSHMAT; i++)
+		if (curproc->shm[i] == 0)
+			break;
+	if (i == NSHMAT)
+		return -1;
+	s = &shmtab.seg[id];
+	acquire(&shmtab.lock);
+	if (s->pages == 0 || shmmap(curproc, i, s) < 0) {
+		release(&shmtab.lock);
+		return -1;
+	}
+	release(&shmtab.lock);
+	return SHMBASE + i * SHMMAX;
+}
+
+// Detach the segment attached at va from the current process.
+int shmdt(uint va) {
+	struct proc *curproc = myproc();
+	struct shmseg *s;
+	int i;
+
+	if (va < SHMBASE || va >= KERNBASE || (va - SHMBASE) % SHMMAX)
+		return -1;
+	i = (va - SHMBASE) / SHMMAX;
+	if ((s = curproc->shm[i]) == 0)
+		return -1;
+	deallocuvm(curproc->pgdir, va + s->npages * PGSIZE, va);
+	switchuvm(curproc);
+	curproc->shm[i] = 0;
+	shmput(s);
+	return 0;
+}
+
+// Give the new child np the same attachments as p, at the same
+// addresses. On failure, np is left with none.
+int shmfork(struct proc *np, struct proc *p) {
+	int i;
+
+	acquire(&shmtab.lock);
+	for (i = 0; i < NSHMAT; i++) {
+		if (p->shm[i] && shmmap(np, i, p->shm[i]) < 0) {
+			release(&shmtab.lock);
+			shmexit(np);
+			return -1;
+		}
+	}
+	release(&shmtab.lock);
+	return 0;
+}
+
+// Drop all of p's attachments, whose mappings go away with p's page
+// table.
+void shmexit(struct proc *p) {
+	int i;
+
+	for (i = 0; i < NSHMAT; i++) {
+		if (p->shm[i]) {
+			shmput(p->shm[i]);
+			p->shm[i] = 0;
+		}
+	}
+}
+
+// Free the segments p created that are not attached anywhere, as p
+// exits. Nothing else would ever free them.
+void shmdisown(struct proc *p) {
+	struct shmseg *s;
+
+	acquire(&shmtab.lock);
+	for (s = shmtab.seg; s < &shmtab.seg[NSHM]; s++) {
+		if (s->pages == 0 || s->creator != p)
+			continue;
+		s->creator = 0;
+		if (s->nattach == 0)
+			shmfree(s);
+	}
+	release(&shmtab.lock);
+}
+
+// Is [va, va+n) inside a segment attached to p?
+int shmcheck(struct proc *p, uint va, uint n) {
+	int i;
+
+	if (va < SHMBASE || va >= KERNBASE)
+		return 0;
+	i = (va - SHMBASE) / SHMMAX;
+	if (p->shm[i] == 0)
+		return 0;
+	return va + n >= va &&
+	       va + n <= SHMBASE + i * SHMMAX + p->shm[i]->npages * PGSIZE;
+}
@@ -0,0 +1,164 @@
+// Slab allocator.
+//
+// Carves pages from kalloc into equal-sized objects, for kernel
+// structures much smaller than a page such as pipes and open files.
+// Each slab cache hands out objects of one size. A slab is one page:
+// a struct slab header followed by as many objects as fit. Slabs with
+// free objects are on their cache's partial list; a slab whose
+// objects are all free goes back to kalloc, except for one spare.
+//
+// In front of the slabs, every CPU has a magazine of free objects per
+// cache. slaballoc() and slabfree() normally touch only the calling
+// CPU's magazine, with interrupts off and no lock taken; a magazine
+// that runs empty or full is refilled or flushed SLABMAG/2 objects at
+// a time under the cache lock.
+//
+// Interface:
+// * slabinit sets up a cache, usually a static struct slabcache.
+// * slaballoc returns an uninitialized object, or 0 if out of memory.
+// * slabfree gives an object back to the cache it came from.
+
+#include "defs.h"
+#include "mmu.h"
+#include "param.h"
+#include "slab.h"
+#include "spinlock.h"
+#include "types.h"
+
+struct slab {
+	struct slab *next; // Partial list
+	struct slab *prev;
+	struct slabcache *sc;
+	char *free; // Free objects, linked through their first word
+	uint inuse; // Objects handed out, including those in magazines
+};
+
+#define SLABHDR ((sizeof(struct slab) + 7) & ~7)
+
+void slabinit(struct slabcache *sc, char *name, uint size) {
+	initlock(&sc->lock, name);
+	sc->name = name;
+	sc->size = (size + 7) & ~7;
+	sc->perslab = (PGSIZE - SLABHDR) / sc->size;
+	if (sc->perslab == 0)
+		panic("slabinit: object too big");
+	sc->partial = 0;
+	sc->spare = 0;
+	sc->nslab = 0;
+	memset(sc->mag, 0, sizeof(sc->mag));
+}
+
+static void slablink(struct slabcache *sc, struct slab *s) {
+	s->prev = 0;
+	s->next = sc->partial;
+	if (sc->partial)
+		sc->partial->prev = s;
+	sc->partial = s;
+}
+
+static void slabunlink(struct slabcache *sc, struct slab *s) {
+	if (s->prev)
+		s->prev->next = s->next;
+	else
+		sc->partial = s->next;
+	if (s->next)
+		s->next->prev = s->prev;
+}
+
+// Get a page from kalloc and make it a slab of free objects.
+// Caller holds sc->lock.
+static struct slab *slabgrow(struct slabcache *sc) {
+	struct slab *s;
+	char *obj;
+	uint i;
+
+	if ((s = (struct slab *)kalloc()) == 0)
+		return 0;
+	s->sc = sc;
+	s->inuse = 0;
+	s->free = 0;
+	for (i = sc->perslab; i > 0; i--) {
+		obj = (char *)s + SLABHDR + (i - 1) * sc->size;
+		*(char **)obj = s->free;
+		s->free = obj;
+	}
+	sc->nslab++;
+	return s;
+}
+
+// Take one object out of the slabs. Caller holds sc->lock.
+static void *slabget(struct slabcache *sc) {
+	struct slab *s;
+	char *obj;
+
+	if ((s = sc->partial) == 0) {
+		if ((s = sc->spare) != 0)
+			sc->spare = 0;
+		else if ((s = slabgrow(sc)) == 0)
+			return 0;
+		slablink(sc, s);
+	}
+	obj = s->free;
+	s->free = *(char **)obj;
+	s->inuse++;
+	if (s->free == 0)
+		slabunlink(sc, s); // now full
+	return obj;
+}
+
+// Put obj back into its slab. Caller holds sc->lock.
+static void slabput(struct slabcache *sc, char *obj) {
+	struct slab *s;
+
+	s = (struct slab *)PGROUNDDOWN((uint)obj);
+	if (s->sc != sc || (uint)(obj - (char *)s - SLABHDR) % sc->size)
+		panic("slabfree");
+	if (s->free == 0)
+		slablink(sc, s); // was full
+	*(char **)obj = s->free;
+	s->free = obj;
+	if (--s->inuse > 0)
+		return;
+	slabunlink(sc, s);
+	if (sc->spare == 0) {
+		sc->spare = s;
+	} else {
+		sc->nslab--;
+		kfree((char *)s);
+	}
+}
+
+// Allocate one object from cache sc.
+// Returns 0 if the memory cannot be allocated.
+void *slaballoc(struct slabcache *sc) {
+	struct magazine *m;
+	void *obj;
+
+	pushcli();
+	m = &sc->mag[cpuid()];
+	if (m->n == 0) {
+		acquire(&sc->lock);
+		while (m->n < SLABMAG / 2 && (obj = slabget(sc)) != 0)
+			m->obj[m->n++] = obj;
+		release(&sc->lock);
+	}
+	obj = m->n > 0 ? m->obj[--m->n] : 0;
+	popcli();
+	return obj;
+}
+
+// Free obj, which slaballoc(sc) returned.
+void slabfree(struct slabcache *sc, void *obj) {
+	struct magazine *m;
+
+	pushcli();
+	m = &sc->mag[cpuid()];
+	if (m->n == SLABMAG) {
+		acquire(&sc->lock);
+		while (m->n > SLABMAG / 2)
+			slabput(sc, m->obj[--m->n]);
+		release(&sc->lock);
+	}
+	m->obj[m->n++] = obj;
+	popcli();
+}
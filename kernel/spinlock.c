@@ -2,6 +2,7 @@
 
 #include "spinlock.h"
 #include "defs.h"
+#include "lockstat.h"
 #include "memlayout.h"
 #include "mmu.h"
 #include "param.h"
@@ -9,24 +10,57 @@
 #include "types.h"
 #include "x86.h"
 
+extern char end[]; // first address after kernel loaded from ELF file
+
+// Locks that live in the kernel image (global tables such as ptable,
+// bcache and kmem) register here so lockstat() can find them. Locks
+// in kalloc()ed memory, such as a pipe's, are not tracked since they
+// may be freed.
+static struct spinlock *lockreg[NLOCKSTAT];
+static uint nlockreg;
+
 void initlock(struct spinlock *lk, char *name) {
+	uint i;
+
 	lk->name = name;
-	lk->locked = 0;
+	lk->next = 0;
+	lk->owner = 0;
 	lk->cpu = 0;
+	lk->nacquire = 0;
+	lk->ncontended = 0;
+	lk->spincycles = 0;
+
+	if ((char *)lk >= end)
+		return;
+	for (i = 0; i < nlockreg && i < NLOCKSTAT; i++)
+		if (lockreg[i] == lk)
+			return;
+	i = __sync_fetch_and_add(&nlockreg, 1);
+	if (i < NLOCKSTAT)
+		lockreg[i] = lk;
 }
 
 // Acquire the lock.
-// Loops (spins) until the lock is acquired.
+// Takes a ticket and spins until the lock is handed to it.
 // Holding a lock for a long time may cause
 // other CPUs to waste time spinning to acquire it.
 void acquire(struct spinlock *lk) {
+	uint ticket;
+	uint64 start;
+
 	pushcli(); // disable interrupts to avoid deadlock.
 	if (holding(lk))
 		panic("acquire");
 
-	// The xchg is atomic.
-	while (xchg(&lk->locked, 1) != 0)
-		;
+	// The lock-prefixed xadd is atomic and is a full barrier, so the
+	// ticket is unique and earlier loads and stores stay before it.
+	ticket = __sync_fetch_and_add(&lk->next, 1);
+	start = 0;
+	if (lk->owner != ticket) {
+		start = rdtsc();
+		while (lk->owner != ticket)
+			pause();
+	}
 
 	// Tell the C compiler and the processor to not move loads or stores
 	// past this point, to ensure that the critical section's memory
@@ -36,6 +70,13 @@ void acquire(struct spinlock *lk) {
 	// Record info about lock acquisition for debugging.
 	lk->cpu = mycpu();
 	getcallerpcs(&lk, lk->pcs);
+
+	// The counters are protected by the lock itself.
+	lk->nacquire++;
+	if (start) {
+		lk->ncontended++;
+		lk->spincycles += rdtsc() - start;
+	}
 }
 
 // Release the lock.
@@ -53,14 +94,46 @@ void release(struct spinlock *lk) {
 	// stores; __sync_synchronize() tells them both not to.
 	__sync_synchronize();
 
-	// Release the lock, equivalent to lk->locked = 0.
-	// This code can't use a C assignment, since it might
-	// not be atomic. A real OS would use C atomics here.
-	asm volatile("movl $0, %0" : "+m"(lk->locked) :);
+	// Serve the next ticket. Only the holder writes owner, so a
+	// plain increment is enough; waiters only read it.
+	asm volatile("incl %0" : "+m"(lk->owner) :);
 
 	popcli();
 }
 
+// Copy the contention counters of the registered locks into ls[],
+// summing locks that share a name. Returns the number of entries
+// filled, at most n. The counters are read without taking the locks,
+// so a snapshot may be slightly stale.
+int lockstats(struct lockstat *ls, int n) {
+	struct spinlock *lk;
+	uint i, nreg;
+	int j, cnt;
+
+	cnt = 0;
+	nreg = nlockreg < NLOCKSTAT ? nlockreg : NLOCKSTAT;
+	for (i = 0; i < nreg; i++) {
+		if ((lk = lockreg[i]) == 0)
+			continue;
+		for (j = 0; j < cnt; j++)
+			if (strncmp(ls[j].name, lk->name,
+				    sizeof(ls[j].name) - 1) == 0)
+				break;
+		if (j == cnt) {
+			if (cnt == n)
+				continue;
+			memset(&ls[j], 0, sizeof(ls[j]));
+			safestrcpy(ls[j].name, lk->name, sizeof(ls[j].name));
+			cnt++;
+		}
+		ls[j].nlocks++;
+		ls[j].nacquire += lk->nacquire;
+		ls[j].ncontended += lk->ncontended;
+		ls[j].spincycles += lk->spincycles;
+	}
+	return cnt;
+}
+
 // Record the current call stack in pcs[] by following the %ebp chain.
 void getcallerpcs(void *v, uint pcs[]) {
 	uint *ebp;
@@ -82,7 +155,7 @@ void getcallerpcs(void *v, uint pcs[]) {
 int holding(struct spinlock *lock) {
 	int r;
 	pushcli();
-	r = lock->locked && lock->cpu == mycpu();
+	r = lock->owner != lock->next && lock->cpu == mycpu();
 	popcli();
 	return r;
 }
@@ -93,19 +166,24 @@ int holding(struct spinlock *lock) {
 
 void pushcli(void) {
 	int eflags;
+	struct cpu *c;
 
 	eflags = readeflags();
 	cli();
-	if (mycpu()->ncli == 0)
-		mycpu()->intena = eflags & FL_IF;
-	mycpu()->ncli += 1;
+	c = mycpu();
+	if (c->ncli == 0)
+		c->intena = eflags & FL_IF;
+	c->ncli += 1;
 }
 
 void popcli(void) {
+	struct cpu *c;
+
 	if (readeflags() & FL_IF)
 		panic("popcli - interruptible");
-	if (--mycpu()->ncli < 0)
+	c = mycpu();
+	if (--c->ncli < 0)
 		panic("popcli");
-	if (mycpu()->ncli == 0 && mycpu()->intena)
+	if (c->ncli == 0 && c->intena)
 		sti();
 }
@@ -0,0 +1,183 @@
+// Swap space.
+//
+// When memory runs short, private user pages are written to the swap
+// area mkfs leaves past the end of the file system (sb.swapstart,
+// sb.nswap blocks) and freed. The page table entry keeps the page's
+// permissions but has PTE_P cleared and PTE_SWAP set, with the swap
+// slot number where the physical address was; pagefault reads the
+// page back through swapin when it is touched again.
+//
+// Victims are picked by a clock sweeping over the user memory of all
+// processes (see vmclock in vm.c). A page the MMU marked accessed
+// since the hand last passed gets a second chance: the hand clears
+// PTE_A and moves on. Only processes that are not running are swept,
+// with the process table locked so none starts: no CPU has their page
+// tables loaded, so no TLB holds the entries being changed.
+//
+// A slot is shared like a page: fork copies swapped-out entries, and
+// each entry holds a reference to its slot. Every reader gets its own
+// copy of the page, so a slot never needs to be written twice.
+//
+// Slot I/O goes through one buffer. Its lock is taken before a victim
+// is chosen and held until the page is on disk, so swapin, which
+// needs the same buffer, cannot read a slot that is still being
+// written.
+
+#include "buf.h"
+#include "defs.h"
+#include "fs.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "param.h"
+#include "proc.h"
+#include "sleeplock.h"
+#include "spinlock.h"
+#include "types.h"
+
+#define SLOTBLOCKS (PGSIZE / BSIZE)
+
+struct {
+	struct spinlock lock;
+	uint dev;
+	uint start;	  // First block of the swap area
+	int nslot;	  // Pages the swap area holds
+	uchar *ref;	  // Page table entries naming each slot
+	int slothand;	  // Where to look for a free slot next
+	int prochand;	  // Process the clock is sweeping
+	uint vahand;	  // and the address in it
+	struct buf buf;	  // For slot I/O; its lock orders writes and reads
+} swap;
+
+void swapinit(int dev) {
+	struct superblock sb;
+
+	initlock(&swap.lock, "swap");
+	initsleeplock(&swap.buf.lock, "swap");
+	readsb(dev, &sb);
+	swap.dev = dev;
+	swap.start = sb.swapstart;
+	swap.nslot = sb.nswap / SLOTBLOCKS;
+	if (swap.nslot > PGSIZE)
+		swap.nslot = PGSIZE; // one page of reference counts
+	if (swap.nslot > 0 && (swap.ref = (uchar *)kalloc_zeroed()) == 0)
+		swap.nslot = 0;
+	if (swap.nslot > 0)
+		cprintf("swap: %d pages at block %d\n", swap.nslot,
+			swap.start);
+}
+
+// Pages of swap space, for the commit limit.
+int swapsize(void) { return swap.nslot; }
+
+// Read or write page through swap.buf, which points straight into
+// it. Caller holds swap.buf.lock.
+static void swapio(char *page, uint slot, int write) {
+	struct buf *b;
+	int i;
+
+	b = &swap.buf;
+	for (i = 0; i < SLOTBLOCKS; i++) {
+		b->dev = swap.dev;
+		b->blockno = swap.start + slot * SLOTBLOCKS + i;
+		b->data = (uchar *)page + i * BSIZE;
+		b->flags = write ? B_DIRTY : 0;
+		iderw(b);
+	}
+}
+
+// Allocate a slot with one reference, or return -1 if swap is full.
+static int slotalloc(void) {
+	int i, slot;
+
+	acquire(&swap.lock);
+	for (i = 0; i < swap.nslot; i++) {
+		slot = (swap.slothand + i) % swap.nslot;
+		if (swap.ref[slot] == 0) {
+			swap.ref[slot] = 1;
+			swap.slothand = (slot + 1) % swap.nslot;
+			release(&swap.lock);
+			return slot;
+		}
+	}
+	release(&swap.lock);
+	return -1;
+}
+
+// Add a reference to slot, for a page table entry fork copied.
+void swapdup(uint slot) {
+	acquire(&swap.lock);
+	if (slot >= swap.nslot || swap.ref[slot] == 0)
+		panic("swapdup");
+	swap.ref[slot]++;
+	release(&swap.lock);
+}
+
+// Drop a reference to slot, for a page table entry that went away.
+void swapfree(uint slot) {
+	acquire(&swap.lock);
+	if (slot >= swap.nslot || swap.ref[slot] == 0)
+		panic("swapfree");
+	swap.ref[slot]--;
+	release(&swap.lock);
+}
+
+// Move the clock to the next page that may be swapped out and return
+// its page table entry. Two sweeps over the whole table give every
+// recently used page time to lose its second chance. Caller holds the
+// process table lock; procs is the table.
+static pte_t *swapvictim(struct proc *procs) {
+	struct proc *p;
+	pte_t *pte;
+	int i;
+
+	for (i = 0; i <= 2 * NPROC; i++) {
+		p = &procs[swap.prochand];
+		if ((p->state == SLEEPING || p->state == RUNNABLE) &&
+		    (pte = vmclock(p, &swap.vahand)) != 0)
+			return pte;
+		swap.prochand = (swap.prochand + 1) % NPROC;
+		swap.vahand = 0;
+	}
+	return 0;
+}
+
+// Write up to n pages to swap and free them. Sleeps, so the caller
+// must hold no spinlocks. Returns the number of pages freed.
+int swapout(int n) {
+	struct proc *procs;
+	pte_t *pte;
+	char *page;
+	int freed, slot;
+
+	if (swap.nslot == 0)
+		return 0;
+	for (freed = 0; freed < n; freed++) {
+		if ((slot = slotalloc()) < 0)
+			break;
+		acquiresleep(&swap.buf.lock);
+		procs = proclock();
+		if ((pte = swapvictim(procs)) == 0) {
+			procunlock();
+			releasesleep(&swap.buf.lock);
+			swapfree(slot);
+			break;
+		}
+		page = P2V(PTE_ADDR(*pte));
+		*pte = slot * PGSIZE | PTE_SWAP |
+		       (PTE_FLAGS(*pte) & ~(PTE_P | PTE_A | PTE_D));
+		procunlock();
+		swapio(page, slot, 1);
+		releasesleep(&swap.buf.lock);
+		kfree(page);
+	}
+	return freed;
+}
+
+// Read slot into page and drop the reference the caller's page table
+// entry held to it. Sleeps.
+void swapin(char *page, uint slot) {
+	acquiresleep(&swap.buf.lock);
+	swapio(page, slot, 0);
+	releasesleep(&swap.buf.lock);
+	swapfree(slot);
+}
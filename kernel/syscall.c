@@ -25,8 +25,10 @@ int fetchstr(uint addr, char **pp) {
 	*pp = (char *)addr;
 	ep = (char *)curproc->sz;
 	for (s = *pp; s < ep; s++) {
-		if (*s == 0)
+		if (*s == 0) {
+			vmhold(curproc, addr, s - *pp + 1);
 			return s - *pp;
+		}
 	}
 	return -1;
 }
@@ -36,20 +38,35 @@ int argint(int n, int *ip) {
 	return fetchint((myproc()->tf->esp) + 4 + 4 * n, ip);
 }
 
-// Helper to get the n-th system call argument as a pointer.
-// Check if the pointer and the data it points to are within the process's
-// memory.
-int argptr(int n, char **pp, int size) {
+// Check that the n-th system call argument points to size bytes of
+// the process's memory, which the kernel may write if write is set.
+static int argrange(int n, char **pp, int size, int write) {
 	int i;
 	struct proc *curproc = myproc();
 	if (argint(n, &i) < 0)
 		return -1;
-	if (size < 0 || (uint)i >= curproc->sz || (uint)i + size > curproc->sz)
+	if (size < 0)
+		return -1;
+	if (((uint)i >= curproc->sz || (uint)i + size > curproc->sz) &&
+	    !shmcheck(curproc, i, size) && !vmacheck(curproc, i, size))
+		return -1;
+	if (write && vmareadonly(curproc, i, size))
+		return -1;
+	vmhold(curproc, i, size);
+	if (vmprefault(curproc, i, size) < 0)
 		return -1;
 	*pp = (char *)i;
 	return 0;
 }
 
+// Helper to get the n-th system call argument as a pointer.
+// Check if the pointer and the data it points to are within the process's
+// memory.
+int argptr(int n, char **pp, int size) { return argrange(n, pp, size, 0); }
+
+// Like argptr, for a buffer the system call writes into.
+int argwptr(int n, char **pp, int size) { return argrange(n, pp, size, 1); }
+
 // Helper to get the n-th system call argument as a string pointer.
 int argstr(int n, char **pp) {
 	int addr;
@@ -94,6 +111,16 @@ extern int sys_halt(void);
 extern int sys_reboot(void);
 extern int sys_get_rtc_time(void);
 extern int sys_get_rtc_date(void);
+extern int sys_lockstat(void);
+extern int sys_memstat(void);
+extern int sys_shmget(void);
+extern int sys_shmat(void);
+extern int sys_shmdt(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_spawn(void);
+extern int sys_sync(void);
+extern int sys_fsync(void);
 
 static int (*syscalls[])(void) = {
 	[SYS_fork] sys_fork,
@@ -131,6 +158,16 @@ static int (*syscalls[])(void) = {
 	[SYS_reboot] sys_reboot,
 	[SYS_get_rtc_time] sys_get_rtc_time,
 	[SYS_get_rtc_date] sys_get_rtc_date,
+	[SYS_lockstat] sys_lockstat,
+	[SYS_memstat] sys_memstat,
+	[SYS_shmget] sys_shmget,
+	[SYS_shmat] sys_shmat,
+	[SYS_shmdt] sys_shmdt,
+	[SYS_mmap] sys_mmap,
+	[SYS_munmap] sys_munmap,
+	[SYS_spawn] sys_spawn,
+	[SYS_sync] sys_sync,
+	[SYS_fsync] sys_fsync,
 };
 
 void syscall(void) {
@@ -138,6 +175,7 @@ void syscall(void) {
 	struct proc *curproc = myproc();
 
 	num = curproc->tf->eax;
+	curproc->nhold = 0;
 	if (num > 0 && num < NELEM(syscalls) && syscalls[num]) {
 		curproc->tf->eax = syscalls[num]();
 	} else {
@@ -145,4 +183,5 @@ void syscall(void) {
 			curproc->name, num);
 		curproc->tf->eax = -1;
 	}
+	curproc->nhold = 0;
 }
\ No newline at end of file
@@ -65,7 +65,7 @@ int sys_read(void) {
 	int n;
 	char *p;
 
-	if (argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+	if (argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argwptr(1, &p, n) < 0)
 		return -1;
 	return fileread(f, p, n);
 }
@@ -95,11 +95,76 @@ int sys_fstat(void) {
 	struct file *f;
 	struct stat *st;
 
-	if (argfd(0, 0, &f) < 0 || argptr(1, (void *)&st, sizeof(*st)) < 0)
+	if (argfd(0, 0, &f) < 0 || argwptr(1, (void *)&st, sizeof(*st)) < 0)
 		return -1;
 	return filestat(f, st);
 }
 
+// Wait until the file's changes so far survive a crash. They are in
+// the log once committed; installing them can wait.
+int sys_fsync(void) {
+	struct file *f;
+
+	if (argfd(0, 0, &f) < 0 || f->type != FD_INODE)
+		return -1;
+	logforce();
+	return 0;
+}
+
+// Write everything committed to its home location on disk.
+int sys_sync(void) {
+	logflush();
+	return 0;
+}
+
+// Map a regular file into memory, read-only or as a private
+// copy-on-write mapping; pages are read in on first touch. The
+// address argument is only a hint and is ignored.
+int sys_mmap(void) {
+	struct file *f;
+	struct inode *ip;
+	int addr, len, prot, flags, off, va;
+	uint size;
+
+	if (argint(0, &addr) < 0 || argint(1, &len) < 0 ||
+	    argint(2, &prot) < 0 || argint(3, &flags) < 0 ||
+	    argfd(4, 0, &f) < 0 || argint(5, &off) < 0)
+		return -1;
+	if (len <= 0 || off < 0 || off % PGSIZE || flags != MAP_PRIVATE ||
+	    !(prot & PROT_READ))
+		return -1;
+	if (f->type != FD_INODE || !f->readable)
+		return -1;
+	ilock(f->ip);
+	if (f->ip->type != T_FILE) {
+		iunlock(f->ip);
+		return -1;
+	}
+	size = f->ip->size;
+	iunlock(f->ip);
+
+	ip = idup(f->ip);
+	va = vmamap(myproc(), ip, off, len, off < size ? size - off : 0,
+		    (prot & PROT_WRITE) != 0);
+	if (va == -1) {
+		begin_op();
+		iput(ip);
+		end_op();
+	}
+	return va;
+}
+
+int sys_munmap(void) {
+	int addr, len, r;
+
+	if (argint(0, &addr) < 0 || argint(1, &len) < 0)
+		return -1;
+	begin_op();
+	r = vmaunmap(myproc(), addr, len);
+	end_op();
+	return r;
+}
+
 // Create the path new as a link to the same inode as old.
 int sys_link(void) {
 	char name[DIRSIZ], *new, *old;
@@ -304,6 +369,8 @@ int sys_open(void) {
 	f->type = FD_INODE;
 	f->ip = ip;
 	f->off = 0;
+	f->ra.pos = 0;
+	f->ra.end = 0;
 	f->readable = !(omode & O_WRONLY);
 	f->writable = (omode & O_WRONLY) || (omode & O_RDWR);
 	return fd;
@@ -363,17 +430,14 @@ int sys_chdir(void) {
 	return 0;
 }
 
-int sys_exec(void) {
-	char *path, *argv[MAXARG];
+// Fetch the null-terminated argument vector at user address uargv.
+static int fetchargv(uint uargv, char *argv[MAXARG]) {
 	int i;
-	uint uargv, uarg;
+	uint uarg;
 
-	if (argstr(0, &path) < 0 || argint(1, (int *)&uargv) < 0) {
-		return -1;
-	}
-	memset(argv, 0, sizeof(argv));
+	memset(argv, 0, MAXARG * sizeof(argv[0]));
 	for (i = 0;; i++) {
-		if (i >= NELEM(argv))
+		if (i >= MAXARG)
 			return -1;
 		if (fetchint(uargv + 4 * i, (int *)&uarg) < 0)
 			return -1;
@@ -384,15 +448,42 @@ int sys_exec(void) {
 		if (fetchstr(uarg, &argv[i]) < 0)
 			return -1;
 	}
+	return 0;
+}
+
+int sys_exec(void) {
+	char *path, *argv[MAXARG];
+	uint uargv;
+
+	if (argstr(0, &path) < 0 || argint(1, (int *)&uargv) < 0 ||
+	    fetchargv(uargv, argv) < 0) {
+		return -1;
+	}
 	return exec(path, argv);
 }
 
+// spawn(path, argv, fd): fd points to the three descriptors the child
+// gets as 0, 1 and 2, or is 0 to pass on the caller's 0, 1 and 2.
+int sys_spawn(void) {
+	char *path, *argv[MAXARG];
+	int *fd, ufd, std[3] = {0, 1, 2};
+	uint uargv;
+
+	if (argstr(0, &path) < 0 || argint(1, (int *)&uargv) < 0 ||
+	    fetchargv(uargv, argv) < 0 || argint(2, &ufd) < 0)
+		return -1;
+	fd = std;
+	if (ufd != 0 && argptr(2, (char **)&fd, 3 * sizeof(fd[0])) < 0)
+		return -1;
+	return spawn(path, argv, fd);
+}
+
 int sys_pipe(void) {
 	int *fd;
 	struct file *rf, *wf;
 	int fd0, fd1;
 
-	if (argptr(0, (void *)&fd, 2 * sizeof(fd[0])) < 0)
+	if (argwptr(0, (void *)&fd, 2 * sizeof(fd[0])) < 0)
 		return -1;
 	if (pipealloc(&rf, &wf) < 0)
 		return -1;
@@ -1,6 +1,8 @@
 #include "date.h"
 #include "defs.h"
+#include "lockstat.h"
 #include "memlayout.h"
+#include "memstat.h"
 #include "mmu.h"
 #include "param.h"
 #include "proc.h"
@@ -97,9 +99,9 @@ int sys_get_rtc_time(void) {
 	int *h, *m, *s;
 
 	// Ubah cast menjadi (char **) agar sesuai dengan defs.h
-	if (argptr(0, (char **)&h, sizeof(int)) < 0 ||
-	    argptr(1, (char **)&m, sizeof(int)) < 0 ||
-	    argptr(2, (char **)&s, sizeof(int)) < 0)
+	if (argwptr(0, (char **)&h, sizeof(int)) < 0 ||
+	    argwptr(1, (char **)&m, sizeof(int)) < 0 ||
+	    argwptr(2, (char **)&s, sizeof(int)) < 0)
 		return -1;
 
 	rtc_read_time(h, m, s);
@@ -110,11 +112,58 @@ int sys_get_rtc_date(void) {
 	int *d, *mo, *y;
 
 	// Ubah cast menjadi (char **) agar sesuai dengan defs.h
-	if (argptr(0, (char **)&d, sizeof(int)) < 0 ||
-	    argptr(1, (char **)&mo, sizeof(int)) < 0 ||
-	    argptr(2, (char **)&y, sizeof(int)) < 0)
+	if (argwptr(0, (char **)&d, sizeof(int)) < 0 ||
+	    argwptr(1, (char **)&mo, sizeof(int)) < 0 ||
+	    argwptr(2, (char **)&y, sizeof(int)) < 0)
 		return -1;
 
 	rtc_read_date(d, mo, y);
 	return 0;
-}
\ No newline at end of file
+}
+
+// Copy spinlock contention counters into a user array of n entries.
+// Returns the number of entries filled.
+int sys_lockstat(void) {
+	struct lockstat *ls;
+	int n;
+
+	if (argint(1, &n) < 0 || n < 0 || n > NLOCKSTAT)
+		return -1;
+	if (argwptr(0, (char **)&ls, n * sizeof(*ls)) < 0)
+		return -1;
+	return lockstats(ls, n);
+}
+
+// Copy physical memory allocator statistics to user space.
+int sys_memstat(void) {
+	struct memstat *st;
+
+	if (argwptr(0, (char **)&st, sizeof(*st)) < 0)
+		return -1;
+	kmemstat(st);
+	return 0;
+}
+
+int sys_shmget(void) {
+	int key, size;
+
+	if (argint(0, &key) < 0 || argint(1, &size) < 0)
+		return -1;
+	return shmget(key, size);
+}
+
+int sys_shmat(void) {
+	int id;
+
+	if (argint(0, &id) < 0)
+		return -1;
+	return shmat(id);
+}
+
+int sys_shmdt(void) {
+	int va;
+
+	if (argint(0, &va) < 0)
+		return -1;
+	return shmdt(va);
+}
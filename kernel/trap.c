@@ -75,8 +75,23 @@ void trap(struct trapframe *tf) {
 		lapiceoi();
 		break;
 
+	case T_PGFLT:
+		// Copy-on-write and other faults the VM system can resolve;
+		// anything else is handled like an unexpected trap below.
+		// Reading a page from disk sleeps, which is only safe if
+		// the faulting code held no spinlocks.
+		if (myproc() && pagefault(myproc(), rcr2(), tf->err,
+					  mycpu()->ncli == 0) == 0)
+			break;
+
 	// PAGEBREAK: 13
 	default:
+		// Interrupt lines PCI devices were given at boot
+		if (tf->trapno >= T_IRQ0 && tf->trapno < T_IRQ0 + 24 &&
+		    virtiointr(tf->trapno - T_IRQ0)) {
+			lapiceoi();
+			break;
+		}
 		if (myproc() == 0 || (tf->cs & 3) == 0) {
 			// In kernel, it must be our mistake.
 			cprintf("unexpected trap %d from cpu %d eip %x "
@@ -0,0 +1,256 @@
+// Virtio block device, legacy PCI interface.
+//
+// When QEMU gives the file system disk as -device virtio-blk-pci,
+// ideinit finds it through virtioinit and idesubmit hands every
+// buffer for device 1 to virtiosubmit instead of the IDE queue.
+//
+// Each buffer becomes its own request: a chain of three descriptors,
+// for the request header, the buffer's data and the status byte the
+// device writes back. Requests are added to the one virtqueue until
+// it is full, so many can be in flight at once, from any number of
+// processes; the device completes them in whatever order it likes.
+// virtiointr takes finished requests off the used ring and passes
+// their buffers to iofinish in ide.c, which wakes their waiters.
+
+#include "buf.h"
+#include "defs.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "param.h"
+#include "pci.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "types.h"
+#include "x86.h"
+
+#define VIRTIO_VENDOR 0x1AF4
+#define VIRTIO_BLK 0x1001 // Transitional block device
+
+// Legacy registers, in the I/O space at BAR0
+#define VIO_GUEST_FEATURES 0x04
+#define VIO_QUEUE_PFN 0x08
+#define VIO_QUEUE_SIZE 0x0C
+#define VIO_QUEUE_SEL 0x0E
+#define VIO_QUEUE_NOTIFY 0x10
+#define VIO_STATUS 0x12
+#define VIO_ISR 0x13
+#define VIO_CAPACITY 0x14 // Device config: size in sectors, 64 bits
+
+#define VIO_S_ACK 0x1
+#define VIO_S_DRIVER 0x2
+#define VIO_S_DRIVER_OK 0x4
+#define VIO_S_FAILED 0x80
+
+#define VIRTQ_MAX 1024 // Largest queue the device may offer
+
+struct vring_desc {
+	uint64 addr; // Physical address
+	uint len;
+	ushort flags;
+	ushort next; // Next in the chain, or in the free list
+};
+
+#define VRING_NEXT 0x1	// next is valid
+#define VRING_WRITE 0x2 // Device writes the buffer
+
+struct vring_avail {
+	ushort flags;
+	ushort idx; // Where the driver puts the next entry
+	ushort ring[];
+};
+
+struct vring_used_elem {
+	uint id; // Head of a finished chain
+	uint len;
+};
+
+struct vring_used {
+	ushort flags;
+	ushort idx; // Where the device puts the next entry
+	struct vring_used_elem ring[];
+};
+
+struct virtio_blk_req {
+	uint type;
+	uint reserved;
+	uint64 sector;
+};
+
+#define VIRTIO_BLK_T_IN 0  // Read
+#define VIRTIO_BLK_T_OUT 1 // Write
+
+#define SECTOR_SIZE 512
+
+static struct {
+	struct spinlock lock;
+	ushort iobase; // 0 if there is no device
+	int irq;
+	uint64 nsector;
+	uint n; // Entries in the queue
+	struct vring_desc *desc;
+	struct vring_avail *avail;
+	struct vring_used *used;
+	int freehead; // Free descriptors, through next
+	int nfree;
+	ushort usedidx; // Used entries taken so far
+
+	// Per request, indexed by its first descriptor
+	struct buf *buf[VIRTQ_MAX];
+	struct virtio_blk_req req[VIRTQ_MAX];
+	uchar status[VIRTQ_MAX];
+} vblk;
+
+// Find and set up the device. Returns 0 if there is none.
+int virtioinit(void) {
+	struct pcidev d;
+	ushort io;
+	uint n, sz, usedoff;
+	char *ring;
+	int i, order;
+
+	if (!pcifind(&d, VIRTIO_VENDOR, VIRTIO_BLK, PCI_ANY, PCI_ANY) ||
+	    !(d.bar[0] & PCI_BAR_IO))
+		return 0;
+	pciwrite(&d, PCI_COMMAND,
+		 (pciread(&d, PCI_COMMAND) & 0xFFFF) | PCI_CMD_IO |
+			 PCI_CMD_MASTER);
+	io = d.bar[0] & ~3;
+
+	outb(io + VIO_STATUS, 0); // reset
+	outb(io + VIO_STATUS, VIO_S_ACK);
+	outb(io + VIO_STATUS, VIO_S_ACK | VIO_S_DRIVER);
+	outl(io + VIO_GUEST_FEATURES, 0); // None needed
+
+	// The legacy interface takes the queue at the size offered:
+	// descriptors and the available ring, then the used ring on
+	// the next page boundary.
+	outw(io + VIO_QUEUE_SEL, 0);
+	n = inw(io + VIO_QUEUE_SIZE);
+	usedoff = PGROUNDUP(n * sizeof(struct vring_desc) + 6 + 2 * n);
+	sz = usedoff + 6 + 8 * n;
+	for (order = 0; (PGSIZE << order) < sz; order++)
+		;
+	if (n == 0 || n > VIRTQ_MAX || (ring = kalloc_pages(order)) == 0) {
+		outb(io + VIO_STATUS, VIO_S_FAILED);
+		return 0;
+	}
+	memset(ring, 0, PGSIZE << order);
+	vblk.desc = (struct vring_desc *)ring;
+	vblk.avail = (struct vring_avail *)(ring + n * sizeof(*vblk.desc));
+	vblk.used = (struct vring_used *)(ring + usedoff);
+	outl(io + VIO_QUEUE_PFN, V2P(ring) / PGSIZE);
+
+	for (i = 0; i < n; i++)
+		vblk.desc[i].next = i + 1;
+	vblk.freehead = 0;
+	vblk.nfree = n;
+	vblk.n = n;
+	vblk.nsector = inl(io + VIO_CAPACITY) |
+		       (uint64)inl(io + VIO_CAPACITY + 4) << 32;
+	vblk.irq = d.irq;
+	initlock(&vblk.lock, "virtio");
+	vblk.iobase = io;
+
+	outb(io + VIO_STATUS, VIO_S_ACK | VIO_S_DRIVER | VIO_S_DRIVER_OK);
+	ioapicenable(vblk.irq, ncpu - 1);
+	cprintf("virtio-blk: %d sectors, %d-entry queue, irq %d\n",
+		(uint)vblk.nsector, n, vblk.irq);
+	return 1;
+}
+
+// Take a descriptor off the free list. Caller holds vblk.lock.
+static int descalloc(void) {
+	int i;
+
+	i = vblk.freehead;
+	vblk.freehead = vblk.desc[i].next;
+	vblk.nfree--;
+	return i;
+}
+
+// Put the chain starting at i back on the free list.
+// Caller holds vblk.lock.
+static void descfree(int i) {
+	int next, more;
+
+	do {
+		more = vblk.desc[i].flags & VRING_NEXT;
+		next = vblk.desc[i].next;
+		vblk.desc[i].flags = 0;
+		vblk.desc[i].next = vblk.freehead;
+		vblk.freehead = i;
+		vblk.nfree++;
+		i = next;
+	} while (more);
+}
+
+// Queue a request for b and return; virtiointr finishes it. Sleeps
+// while the queue is full. Caller holds b->lock.
+void virtiosubmit(struct buf *b) {
+	int h, d, s, write;
+
+	if ((uint64)(b->blockno + 1) * (BSIZE / SECTOR_SIZE) > vblk.nsector)
+		panic("virtiosubmit: block out of range");
+	write = b->flags & B_DIRTY;
+
+	acquire(&vblk.lock);
+	while (vblk.nfree < 3)
+		sleep(&vblk.nfree, &vblk.lock);
+	h = descalloc();
+	d = descalloc();
+	s = descalloc();
+
+	vblk.req[h].type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	vblk.req[h].reserved = 0;
+	vblk.req[h].sector = (uint64)b->blockno * (BSIZE / SECTOR_SIZE);
+	vblk.status[h] = 0xFF;
+	vblk.buf[h] = b;
+
+	vblk.desc[h].addr = V2P(&vblk.req[h]);
+	vblk.desc[h].len = sizeof(struct virtio_blk_req);
+	vblk.desc[h].flags = VRING_NEXT;
+	vblk.desc[h].next = d;
+	vblk.desc[d].addr = V2P(b->data);
+	vblk.desc[d].len = BSIZE;
+	vblk.desc[d].flags = VRING_NEXT | (write ? 0 : VRING_WRITE);
+	vblk.desc[d].next = s;
+	vblk.desc[s].addr = V2P(&vblk.status[h]);
+	vblk.desc[s].len = 1;
+	vblk.desc[s].flags = VRING_WRITE;
+
+	// The device may look at the ring as soon as idx moves.
+	vblk.avail->ring[vblk.avail->idx % vblk.n] = h;
+	__sync_synchronize();
+	vblk.avail->idx++;
+	__sync_synchronize();
+	outw(vblk.iobase + VIO_QUEUE_NOTIFY, 0);
+	release(&vblk.lock);
+}
+
+// Handle an interrupt on line irq, if it is the device's.
+// Returns 0 if it is not.
+int virtiointr(int irq) {
+	struct buf *b;
+	int h, ok;
+
+	if (vblk.iobase == 0 || irq != vblk.irq)
+		return 0;
+
+	acquire(&vblk.lock);
+	inb(vblk.iobase + VIO_ISR); // Acknowledge
+	while (vblk.usedidx != vblk.used->idx) {
+		__sync_synchronize();
+		h = vblk.used->ring[vblk.usedidx % vblk.n].id;
+		vblk.usedidx++;
+		b = vblk.buf[h];
+		vblk.buf[h] = 0;
+		ok = vblk.status[h] == 0;
+		if (!ok)
+			cprintf("virtio-blk: error on block %d\n", b->blockno);
+		descfree(h);
+		iofinish(b, ok);
+	}
+	wakeup(&vblk.nfree);
+	release(&vblk.lock);
+	return 1;
+}
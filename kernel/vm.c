@@ -6,25 +6,59 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "spinlock.h"
+#include "fs.h"
+#include "file.h"
 
 extern char data[]; // defined by kernel.ld
+extern char end[];  // first address after kernel loaded from ELF file
 pde_t *kpgdir;	    // for use in scheduler()
 
+// Commit accounting for user memory. sbrk only reserves address space
+// and pages are allocated on first touch, so the sizes of all live
+// processes are charged against a limit of OVERCOMMIT percent of the
+// allocatable memory plus swap space to keep those promises within
+// reason.
+static struct {
+	struct spinlock lock;
+	uint committed; // pages charged to processes
+} vmacct;
+
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
 void seginit(void) {
 	struct cpu *c;
+	int apicid, i;
+
+	// Find this CPU's entry by its Local APIC ID. APIC IDs are not
+	// guaranteed to be contiguous, so scan; this is the only place
+	// that has to, since mycpu() reads the result back through %gs.
+	apicid = lapicid();
+	for (i = 0; i < ncpu; ++i)
+		if (cpus[i].apicid == apicid)
+			break;
+	if (i == ncpu)
+		panic("unknown apicid\n");
+	c = &cpus[i];
 
 	// Map "logical" addresses to virtual addresses using identity map.
 	// Cannot share a CODE descriptor for both kernel and user
 	// because it would have to have DPL_USR, but the CPU forbids
 	// an interrupt from CPL=0 to DPL=3.
-	c = &cpus[cpuid()];
 	c->gdt[SEG_KCODE] = SEG(STA_X | STA_R, 0, 0xffffffff, 0);
 	c->gdt[SEG_KDATA] = SEG(STA_W, 0, 0xffffffff, 0);
 	c->gdt[SEG_UCODE] = SEG(STA_X | STA_R, 0, 0xffffffff, DPL_USER);
 	c->gdt[SEG_UDATA] = SEG(STA_W, 0, 0xffffffff, DPL_USER);
+
+	// Map cpu-local storage; private to this cpu. alltraps reloads
+	// %gs with this selector on every entry into the kernel.
+	c->gdt[SEG_KCPU] = SEG(STA_W, &c->self, 8, 0);
+
 	lgdt(c->gdt, sizeof(c->gdt));
+	loadgs(SEG_KCPU << 3);
+
+	c->self = c;
+	c->proc = 0;
 }
 
 // Return the address of the PTE in page table pgdir
@@ -38,10 +72,9 @@ static pte_t *walkpgdir(pde_t *pgdir, const void *va, int alloc) {
 	if (*pde & PTE_P) {
 		pgtab = (pte_t *)P2V(PTE_ADDR(*pde));
 	} else {
-		if (!alloc || (pgtab = (pte_t *)kalloc()) == 0)
+		// kalloc_zeroed makes sure all those PTE_P bits are zero.
+		if (!alloc || (pgtab = (pte_t *)kalloc_zeroed()) == 0)
 			return 0;
-		// Make sure all those PTE_P bits are zero.
-		memset(pgtab, 0, PGSIZE);
 		// The permissions here are overly generous, but they can
 		// be further restricted by the permissions in the page table
 		// entries, if necessary.
@@ -73,12 +106,47 @@ static int mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm) {
 	return 0;
 }
 
+// Like mappages, but uses a 4 MB page (PTE_PS) for each 4 MB-aligned
+// stretch of the range, so the kernel's direct map of a large memory
+// does not need a page table per 4 MB, and one TLB entry covers 4 MB.
+// Only for kernel mappings: nothing below KERNBASE may use PTE_PS.
+static int mappages4m(pde_t *pgdir, void *va, uint size, uint pa, int perm) {
+	uint a, n;
+
+	a = (uint)va;
+	while (size > 0) {
+		if (a % PGSIZE4M == 0 && pa % PGSIZE4M == 0 &&
+		    size >= PGSIZE4M) {
+			if (pgdir[PDX(a)] & PTE_P)
+				panic("remap");
+			pgdir[PDX(a)] = pa | perm | PTE_PS | PTE_P;
+			n = PGSIZE4M;
+		} else {
+			n = PGSIZE4M - a % PGSIZE4M;
+			if (n > size)
+				n = size;
+			if (mappages(pgdir, (void *)a, n, pa, perm) < 0)
+				return -1;
+		}
+		a += n;
+		pa += n;
+		size -= n;
+	}
+	return 0;
+}
+
 // There is one page table per process, plus one that's used when
 // a CPU is not running any process (kpgdir). The kernel uses the
 // current process's page table during system calls and interrupts;
 // page protection bits prevent user code from using the kernel's
 // mappings.
 //
+// kvmalloc() builds the kernel part of the page tables, above
+// KERNBASE, once; setupkvm() gives every page table a copy of the same
+// page directory entries, sharing the kernel's page tables. The kernel
+// mappings never change after boot and are global (PTE_G), so they
+// also survive in the TLB when switchuvm() loads a new %cr3.
+//
 // setupkvm() and exec() set up every page table like this:
 //
 //   0..KERNBASE: user memory (text+data+stack+heap), mapped to
@@ -86,13 +154,15 @@ static int mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm) {
 //   KERNBASE..KERNBASE+EXTMEM: mapped to 0..EXTMEM (for I/O space)
 //   KERNBASE+EXTMEM..data: mapped to EXTMEM..V2P(data)
 //                for the kernel's instructions and r/o data
-//   data..KERNBASE+PHYSTOP: mapped to V2P(data)..PHYSTOP,
-//                                  rw data + free physical memory
-//   0xfe000000..0: mapped direct (devices such as ioapic)
+//   data..KERNBASE+phystop: mapped to V2P(data)..phystop,
+//                                  rw data + free physical memory,
+//                                  with 4 MB pages where aligned
+//   DEVSPACE..0: mapped direct (devices such as ioapic, and the
+//                VBE framebuffer), with 4 MB pages
 //
 // The kernel allocates physical memory for its heap and for user memory
-// between V2P(end) and the end of physical memory (PHYSTOP)
-// (directly addressable from end..P2V(PHYSTOP)).
+// between V2P(end) and the end of physical memory (phystop, sized at
+// boot by e820init) (directly addressable from end..P2V(phystop)).
 
 // This table defines the kernel's mappings, which are present in
 // every process's page table.
@@ -101,39 +171,49 @@ static struct kmap {
 	uint phys_start;
 	uint phys_end;
 	int perm;
+	int big; // may use 4 MB pages
 } kmap[] = {
-	{(void *)KERNBASE, 0, EXTMEM, PTE_W},		 // I/O space
-	{(void *)KERNLINK, V2P(KERNLINK), V2P(data), 0}, // kern text+rodata
-	{(void *)data, V2P(data), PHYSTOP, PTE_W},	 // kern data+memory
-	{(void *)DEVSPACE, DEVSPACE, 0, PTE_W},		 // more devices
+	{(void *)KERNBASE, 0, EXTMEM, PTE_W | PTE_G, 0},	// I/O space
+	{(void *)KERNLINK, V2P(KERNLINK), V2P(data), PTE_G, 0}, // kern text
+	{(void *)data, V2P(data), 0, PTE_W | PTE_G, 1},		// kern data+mem
+	{(void *)DEVSPACE, DEVSPACE, 0, PTE_W | PTE_G, 1},	// more devices
 };
 
-// Set up kernel part of a page table.
+// Set up kernel part of a page table by sharing kpgdir's.
 pde_t *setupkvm(void) {
 	pde_t *pgdir;
-	struct kmap *k;
 
-	if ((pgdir = (pde_t *)kalloc()) == 0)
+	if ((pgdir = (pde_t *)kalloc_zeroed()) == 0)
 		return 0;
-	memset(pgdir, 0, PGSIZE);
-	if (P2V(PHYSTOP) > (void *)DEVSPACE)
-		panic("PHYSTOP too high");
-	for (k = kmap; k < &kmap[NELEM(kmap)]; k++)
-		if (mappages(pgdir, k->virt, k->phys_end - k->phys_start,
-			     (uint)k->phys_start, k->perm) < 0) {
-			freevm(pgdir);
-			return 0;
-		}
+	memmove(&pgdir[PDX(KERNBASE)], &kpgdir[PDX(KERNBASE)],
+		(NPDENTRIES - PDX(KERNBASE)) * sizeof(pde_t));
 	return pgdir;
 }
 
 // Allocate one page table for the machine for the kernel address
-// space for scheduler processes.
+// space for scheduler processes, and build the kernel mappings
+// that setupkvm() shares with every other page table.
 void kvmalloc(void) {
-	kpgdir = setupkvm();
+	struct kmap *k;
+
+	initlock(&vmacct.lock, "vmacct");
+	if (P2V(phystop) > (void *)DEVSPACE)
+		panic("phystop too high");
+	kmap[2].phys_end = phystop; // known only now, see e820init
+	if ((kpgdir = (pde_t *)kalloc_zeroed()) == 0)
+		panic("kvmalloc");
+	for (k = kmap; k < &kmap[NELEM(kmap)]; k++)
+		if ((k->big ? mappages4m : mappages)(
+			kpgdir, k->virt, k->phys_end - k->phys_start,
+			(uint)k->phys_start, k->perm) < 0)
+			panic("kvmalloc");
 	switchkvm();
+	kvmenable();
 }
 
+// Turn on global pages on this CPU, once it runs on kpgdir.
+void kvmenable(void) { lcr4(rcr4() | CR4_PGE); }
+
 // Switch h/w page table register to the kernel-only page table,
 // for when no process is running.
 void switchkvm(void) {
@@ -170,8 +250,7 @@ void inituvm(pde_t *pgdir, char *init, uint sz) {
 
 	if (sz >= PGSIZE)
 		panic("inituvm: more than a page");
-	mem = kalloc();
-	memset(mem, 0, PGSIZE);
+	mem = kalloc_zeroed();
 	mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W | PTE_U);
 	memmove(mem, init, sz);
 }
@@ -181,9 +260,12 @@ void inituvm(pde_t *pgdir, char *init, uint sz) {
 int loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz) {
 	uint i, pa, n;
 	pte_t *pte;
+	struct rastate ra;
 
 	if ((uint)addr % PGSIZE != 0)
 		panic("loaduvm: addr must be page aligned");
+	ra.pos = offset / BSIZE;
+	ra.end = 0;
 	for (i = 0; i < sz; i += PGSIZE) {
 		if ((pte = walkpgdir(pgdir, addr + i, 0)) == 0)
 			panic("loaduvm: address should exist");
@@ -192,7 +274,7 @@ int loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz) {
 			n = sz - i;
 		else
 			n = PGSIZE;
-		if (readi(ip, P2V(pa), offset + i, n) != n)
+		if (readira(ip, P2V(pa), offset + i, n, &ra) != n)
 			return -1;
 	}
 	return 0;
@@ -211,13 +293,12 @@ int allocuvm(pde_t *pgdir, uint oldsz, uint newsz) {
 
 	a = PGROUNDUP(oldsz);
 	for (; a < newsz; a += PGSIZE) {
-		mem = kalloc();
+		mem = kalloc_zeroed();
 		if (mem == 0) {
 			cprintf("allocuvm out of memory\n");
 			deallocuvm(pgdir, newsz, oldsz);
 			return 0;
 		}
-		memset(mem, 0, PGSIZE);
 		if (mappages(pgdir, (char *)a, PGSIZE, V2P(mem),
 			     PTE_W | PTE_U) < 0) {
 			cprintf("allocuvm out of memory (2)\n");
@@ -252,6 +333,9 @@ int deallocuvm(pde_t *pgdir, uint oldsz, uint newsz) {
 			char *v = P2V(pa);
 			kfree(v);
 			*pte = 0;
+		} else if ((*pte & PTE_SWAP) != 0) {
+			swapfree(PTE_ADDR(*pte) / PGSIZE);
+			*pte = 0;
 		}
 	}
 	return newsz;
@@ -265,7 +349,8 @@ void freevm(pde_t *pgdir) {
 	if (pgdir == 0)
 		panic("freevm: no pgdir");
 	deallocuvm(pgdir, KERNBASE, 0);
-	for (i = 0; i < NPDENTRIES; i++) {
+	// Page tables above KERNBASE belong to kpgdir.
+	for (i = 0; i < PDX(KERNBASE); i++) {
 		if (pgdir[i] & PTE_P) {
 			char *v = P2V(PTE_ADDR(pgdir[i]));
 			kfree(v);
@@ -285,35 +370,444 @@ void clearpteu(pde_t *pgdir, char *uva) {
 	*pte &= ~PTE_U;
 }
 
-// Given a parent process's page table, create a copy
-// of it for a child.
-pde_t *copyuvm(pde_t *pgdir, uint sz) {
-	pde_t *d;
-	pte_t *pte;
+// Map the present pages of pgdir in [start, end) into d as well,
+// making writable ones copy-on-write in both. Swapped-out pages are
+// shared by giving d a reference to the same swap slot.
+static int copyrange(pde_t *pgdir, pde_t *d, uint start, uint end) {
+	pte_t *pte, *npte;
 	uint pa, i, flags;
-	char *mem;
 
-	if ((d = setupkvm()) == 0)
-		return 0;
-	for (i = 0; i < sz; i += PGSIZE) {
-		if ((pte = walkpgdir(pgdir, (void *)i, 0)) == 0)
-			panic("copyuvm: pte should exist");
+	for (i = start; i < end; i += PGSIZE) {
+		// Lazily allocated pages that were never touched are
+		// simply not there yet, in the child as in the parent.
+		if ((pte = walkpgdir(pgdir, (void *)i, 0)) == 0) {
+			i = PGADDR(PDX(i) + 1, 0, 0) - PGSIZE;
+			continue;
+		}
+		if (*pte & PTE_SWAP) {
+			if ((npte = walkpgdir(d, (void *)i, 1)) == 0)
+				return -1;
+			swapdup(PTE_ADDR(*pte) / PGSIZE);
+			*npte = *pte;
+			continue;
+		}
 		if (!(*pte & PTE_P))
-			panic("copyuvm: page not present");
+			continue;
+		if (*pte & PTE_W)
+			*pte = (*pte & ~PTE_W) | PTE_COW;
 		pa = PTE_ADDR(*pte);
 		flags = PTE_FLAGS(*pte);
-		if ((mem = kalloc()) == 0)
-			goto bad;
-		memmove(mem, (char *)P2V(pa), PGSIZE);
-		if (mappages(d, (void *)i, PGSIZE, V2P(mem), flags) < 0) {
-			kfree(mem);
-			goto bad;
-		}
+		if (mappages(d, (void *)i, PGSIZE, pa, flags) < 0)
+			return -1;
+		kincref(P2V(pa));
 	}
+	return 0;
+}
+
+// Given a parent process, create a copy of its page table for a
+// child. User pages are not copied: both page tables map them
+// read-only with PTE_COW set, and whichever process writes first gets
+// its own copy in cowfault(). p must be the current process, since
+// its write permissions change here.
+pde_t *copyuvm(struct proc *p) {
+	pde_t *d;
+	struct vma *v;
+
+	if ((d = setupkvm()) == 0)
+		return 0;
+	if (copyrange(p->pgdir, d, 0, p->sz) < 0)
+		goto bad;
+	// mmap regions lie above p->sz.
+	for (v = p->vma; v < &p->vma[NVMA]; v++)
+		if (v->ip && v->start >= p->sz &&
+		    copyrange(p->pgdir, d, v->start, v->end) < 0)
+			goto bad;
+	lcr3(V2P(p->pgdir)); // flush the parent's now read-only TLB entries
 	return d;
 
 bad:
 	freevm(d);
+	lcr3(V2P(p->pgdir));
+	return 0;
+}
+
+// Out of memory while resolving a fault. If the faulting code can
+// wait, swap some pages out and have it retry the access; the retry
+// finds the page table as it is then, since the faulting process's
+// own pages may go too while it sleeps.
+static int faultoom(int cansleep) {
+	if (!cansleep)
+		return -1;
+	sti();
+	return swapout(SWAPBATCH) > 0 ? 0 : -1;
+}
+
+// Handle a write fault on the copy-on-write page holding va: copy the
+// page, or if no other page table still shares it, simply make it
+// writable again. Returns -1 if va is not a copy-on-write page or
+// there is no memory for the copy.
+static int cowfault(pde_t *pgdir, uint va, int cansleep) {
+	pte_t *pte;
+	uint pa;
+	char *mem;
+
+	if ((pte = walkpgdir(pgdir, (void *)va, 0)) == 0)
+		return -1;
+	if ((*pte & (PTE_P | PTE_COW)) != (PTE_P | PTE_COW))
+		return -1;
+	pa = PTE_ADDR(*pte);
+	if (krefcount(P2V(pa)) == 1) {
+		*pte = (*pte | PTE_W) & ~PTE_COW;
+	} else {
+		if ((mem = kalloc()) == 0)
+			return faultoom(cansleep);
+		memmove(mem, P2V(pa), PGSIZE);
+		*pte = V2P(mem) | ((PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW);
+		kfree(P2V(pa));
+	}
+	invlpg((void *)va);
+	return 0;
+}
+
+// Map a zero-filled page at va, which lies below p->sz but was never
+// touched since sbrk reserved it, or past the end of a mapped file.
+// Returns -1 if out of memory.
+static int lazyfault(pde_t *pgdir, uint va, int perm, int cansleep) {
+	char *mem;
+
+	if ((mem = kalloc_zeroed()) == 0)
+		return faultoom(cansleep);
+	if (mappages(pgdir, (char *)va, PGSIZE, V2P(mem), perm) < 0) {
+		kfree(mem);
+		return faultoom(cansleep);
+	}
+	return 0;
+}
+
+// Read the swapped-out page whose entry is pte back in from swap.
+static int swapfault(pte_t *pte, int cansleep) {
+	char *mem;
+
+	if (!cansleep)
+		return -1;
+	sti();
+	if ((mem = kalloc()) == 0)
+		return faultoom(cansleep);
+	swapin(mem, PTE_ADDR(*pte) / PGSIZE);
+	*pte = V2P(mem) | (PTE_FLAGS(*pte) & ~PTE_SWAP) | PTE_P;
+	return 0;
+}
+
+// Map the page of file region v holding va, taking it from the page
+// cache. Writable regions map it copy-on-write, so a process that
+// writes gets a private copy and the cached page stays clean.
+static int filefault(pde_t *pgdir, struct vma *v, uint va, int cansleep) {
+	char *mem;
+	uint n;
+
+	if (va - v->start >= v->filesz)
+		return lazyfault(pgdir, va, PTE_U | (v->writable ? PTE_W : 0),
+				 cansleep);
+	n = v->filesz - (va - v->start);
+	if (n > PGSIZE)
+		n = PGSIZE;
+	if ((mem = pcacheget(v->ip, v->off + (va - v->start), n, 0)) == 0) {
+		if (!cansleep)
+			return -1;
+		sti();
+		if ((mem = pcacheget(v->ip, v->off + (va - v->start), n,
+				     1)) == 0)
+			return -1;
+	}
+	if (mappages(pgdir, (char *)va, PGSIZE, V2P(mem),
+		     PTE_U | (v->writable ? PTE_COW : 0)) < 0) {
+		kfree(mem);
+		return -1;
+	}
+	return 0;
+}
+
+// Resolve a page fault at va in process p's address space, whether it
+// came from user mode or from the kernel touching user memory during
+// a system call. err is the hardware error code; cansleep says whether
+// the faulting code held no spinlocks, so a page may be read from disk.
+// Returns 0 if the faulting access can be retried, -1 if it is a
+// genuine fault.
+int pagefault(struct proc *p, uint va, uint err, int cansleep) {
+	struct vma *v;
+	pte_t *pte;
+
+	if (va >= KERNBASE)
+		return -1;
+	// The kernel may have another process's page table loaded (the
+	// window manager reads window buffers that way); p->sz says
+	// nothing about that one.
+	if (V2P(p->pgdir) != rcr3())
+		return -1;
+	va = PGROUNDDOWN(va);
+	if ((err & (FEC_PR | FEC_WR)) == (FEC_PR | FEC_WR))
+		return cowfault(p->pgdir, va, cansleep);
+	if (err & FEC_PR)
+		return -1;
+	pte = walkpgdir(p->pgdir, (char *)va, 0);
+	if (pte && (*pte & PTE_SWAP))
+		return swapfault(pte, cansleep);
+	for (v = p->vma; v < &p->vma[NVMA]; v++)
+		if (v->ip && va >= v->start && va < v->end)
+			return filefault(p->pgdir, v, va, cansleep);
+	if (va < p->sz)
+		return lazyfault(p->pgdir, va, PTE_W | PTE_U, cansleep);
+	return -1;
+}
+
+// Fault in any missing pages of p's memory in [va, va+n) before a
+// system call works on them, so that copies done later under a lock
+// never have to wait for the disk. A fault may only have made room,
+// so each page is checked again until it is there. Returns -1 if a
+// page cannot be provided.
+int vmprefault(struct proc *p, uint va, uint n) {
+	uint a;
+	pte_t *pte;
+
+	if (n == 0)
+		return 0;
+	for (a = PGROUNDDOWN(va); a < va + n;) {
+		pte = walkpgdir(p->pgdir, (char *)a, 0);
+		if (pte && (*pte & PTE_P)) {
+			a += PGSIZE;
+			continue;
+		}
+		if (pagefault(p, a, 0, 1) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+// Note that p's current system call works on [va, va+n), so that the
+// swap clock leaves those pages alone until the next system call: the
+// kernel may touch them holding a spinlock, and cannot then wait for
+// the disk. Past NUHOLD ranges, all of p's memory stays.
+void vmhold(struct proc *p, uint va, uint n) {
+	if (p->nhold < NUHOLD) {
+		p->hold[p->nhold].start = va;
+		p->hold[p->nhold].end = va + n;
+	}
+	if (p->nhold <= NUHOLD)
+		p->nhold++;
+}
+
+// Is the page at va in one of the ranges p's system call holds?
+static int vmheld(struct proc *p, uint va) {
+	int i;
+
+	if (p->nhold > NUHOLD)
+		return 1;
+	for (i = 0; i < p->nhold; i++)
+		if (va < p->hold[i].end && va + PGSIZE > p->hold[i].start)
+			return 1;
+	return 0;
+}
+
+// Keep p's pages in [va, va+n) in memory for good. The window manager
+// draws from window buffers holding its spinlock, with the owner's
+// page table loaded, long after the system call that handed them
+// over. Returns -1 if the range is not all p's memory.
+int vmpin(struct proc *p, uint va, uint n) {
+	uint a;
+
+	if (va + n < va || va + n > p->sz)
+		return -1;
+	vmhold(p, va, n);
+	if (vmprefault(p, va, n) < 0)
+		return -1;
+	for (a = PGROUNDDOWN(va); a < va + n; a += PGSIZE)
+		*walkpgdir(p->pgdir, (char *)a, 0) |= PTE_PIN;
+	return 0;
+}
+
+// Advance the swap clock's hand *va through p's user memory to the
+// next page swapout may take, and return its page table entry; return
+// 0 at the end of p's memory. A page used since the hand last passed
+// has its PTE_A cleared instead and is spared this time. Only private
+// pages (one reference) go, and not pinned or held ones. p must not
+// be running, so that no TLB caches its entries.
+pte_t *vmclock(struct proc *p, uint *va) {
+	pte_t *pte;
+	uint a;
+
+	for (a = *va; a < KERNBASE; a += PGSIZE) {
+		if ((pte = walkpgdir(p->pgdir, (char *)a, 0)) == 0) {
+			a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+			continue;
+		}
+		if ((*pte & (PTE_P | PTE_U | PTE_PIN)) != (PTE_P | PTE_U))
+			continue;
+		if (*pte & PTE_A) {
+			*pte &= ~PTE_A;
+			continue;
+		}
+		if (krefcount(P2V(PTE_ADDR(*pte))) != 1 || vmheld(p, a))
+			continue;
+		*va = a + PGSIZE;
+		return pte;
+	}
+	return 0;
+}
+
+// Map the n pages in pages[] at va in pgdir, writable by the user,
+// adding a reference to each for the new mapping. Returns -1 with
+// nothing mapped if out of memory for page tables.
+int mapshared(pde_t *pgdir, uint va, char **pages, int n) {
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if (mappages(pgdir, (char *)va + i * PGSIZE, PGSIZE,
+			     V2P(pages[i]), PTE_W | PTE_U) < 0) {
+			deallocuvm(pgdir, va + i * PGSIZE, va);
+			return -1;
+		}
+		kincref(pages[i]);
+	}
+	return 0;
+}
+
+// Give np references to all of p's file-backed regions.
+void vmadup(struct proc *np, struct proc *p) {
+	int i;
+
+	for (i = 0; i < NVMA; i++) {
+		np->vma[i] = p->vma[i];
+		if (p->vma[i].ip)
+			idup(p->vma[i].ip);
+	}
+}
+
+// Is [va, va+n) inside one of p's file-backed regions?
+int vmacheck(struct proc *p, uint va, uint n) {
+	struct vma *v;
+
+	for (v = p->vma; v < &p->vma[NVMA]; v++)
+		if (v->ip && va >= v->start && va + n >= va &&
+		    va + n <= v->end)
+			return 1;
+	return 0;
+}
+
+// Does [va, va+n) touch a read-only file-backed region of p, whether
+// mapped by mmap or by exec?
+int vmareadonly(struct proc *p, uint va, uint n) {
+	struct vma *v;
+
+	for (v = p->vma; v < &p->vma[NVMA]; v++)
+		if (v->ip && !v->writable && va < v->end &&
+		    va + n > v->start)
+			return 1;
+	return 0;
+}
+
+// Lowest address of p's mmap regions, which sbrk must stay below;
+// SHMBASE if there are none.
+uint vmamapfloor(struct proc *p) {
+	struct vma *v;
+	uint floor;
+
+	floor = SHMBASE;
+	for (v = p->vma; v < &p->vma[NVMA]; v++)
+		if (v->ip && v->start >= p->sz && v->start < v->end &&
+		    v->start < floor)
+			floor = v->start;
+	return floor;
+}
+
+// Map n bytes of ip, from page-aligned offset off, into p's address
+// space below its other mmap regions: read-only, or if writable as a
+// private copy-on-write mapping. Takes over the caller's reference to
+// ip. Returns the address of the mapping, or -1.
+int vmamap(struct proc *p, struct inode *ip, uint off, uint n, uint filesz,
+	   int writable) {
+	struct vma *v, *free;
+	uint va;
+
+	free = 0;
+	for (v = p->vma; v < &p->vma[NVMA]; v++)
+		if (v->ip == 0 && free == 0)
+			free = v;
+	if (free == 0 || n == 0 || n > SHMBASE)
+		return -1;
+	va = vmamapfloor(p) - PGROUNDUP(n);
+	if (va > vmamapfloor(p) || va < PGROUNDUP(p->sz))
+		return -1;
+	free->start = va;
+	free->end = va + PGROUNDUP(n);
+	free->ip = ip;
+	free->off = off;
+	free->filesz = filesz < n ? filesz : n;
+	free->writable = writable;
+	return va;
+}
+
+// Unmap [va, va+n) from p, which must be all of an mmap region or a
+// piece at either end of one. The pages go, private copies included.
+// Must be called inside a transaction, as it may release the last
+// reference to an inode.
+int vmaunmap(struct proc *p, uint va, uint n) {
+	struct vma *v;
+	uint end;
+
+	end = va + PGROUNDUP(n);
+	if (va % PGSIZE || n == 0 || end < va)
+		return -1;
+	for (v = p->vma; v < &p->vma[NVMA]; v++)
+		if (v->ip && v->start >= p->sz && va >= v->start &&
+		    end <= v->end)
+			break;
+	if (v == &p->vma[NVMA] || (va != v->start && end != v->end))
+		return -1;
+	deallocuvm(p->pgdir, end, va);
+	switchuvm(p);
+	if (va == v->start && end == v->end) {
+		iput(v->ip);
+		v->ip = 0;
+	} else if (va == v->start) {
+		v->start = end;
+		v->off += end - va;
+		v->filesz = v->filesz > end - va ? v->filesz - (end - va) : 0;
+	} else {
+		v->end = va;
+	}
+	return 0;
+}
+
+// Drop p's file-backed regions. Must be called inside a transaction,
+// as it may release the last reference to an inode.
+void vmaput(struct proc *p) {
+	int i;
+
+	for (i = 0; i < NVMA; i++) {
+		if (p->vma[i].ip)
+			iput(p->vma[i].ip);
+		p->vma[i].ip = 0;
+	}
+}
+
+// Charge a change in a process's size from oldsz to newsz bytes to the
+// commit accounting. Growth fails with -1 if it would take the total
+// past the overcommit limit; shrinking always succeeds.
+int vmcharge(uint oldsz, uint newsz) {
+	int delta;
+	uint limit;
+
+	delta = (int)(PGROUNDUP(newsz) / PGSIZE) -
+		(int)(PGROUNDUP(oldsz) / PGSIZE);
+	limit = ((phystop - V2P(end)) / PGSIZE + swapsize()) / 100 * OVERCOMMIT;
+
+	acquire(&vmacct.lock);
+	if (delta > 0 && vmacct.committed + delta > limit) {
+		release(&vmacct.lock);
+		return -1;
+	}
+	vmacct.committed += delta;
+	release(&vmacct.lock);
 	return 0;
 }
 
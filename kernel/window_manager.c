@@ -781,31 +781,48 @@ int turnoffScreen() {
 	return 0;
 }
 
+// The window manager draws from a window's buffer in its owner's
+// memory while holding wmlock, so the buffer must never be swapped out.
+static int pinWindowBuffer(window *wnd) {
+	if (wnd->width <= 0 || wnd->height <= 0)
+		return -1;
+	return vmpin(myproc(), (uint)wnd->window_buf,
+		     wnd->width * wnd->height * sizeof(struct RGB));
+}
+
 int sys_GUI_createPopupWindow() {
 	window *wnd;
 	int caller;
-	argptr(0, (char **)&wnd, sizeof(window));
+	if (argwptr(0, (char **)&wnd, sizeof(window)) < 0)
+		return -1;
 	argint(1, &caller);
+	if (pinWindowBuffer(wnd) < 0)
+		return 1;
 	return createPopupWindow(wnd, caller);
 }
 
 int sys_GUI_closePopupWindow() {
 	window *wnd;
-	argptr(0, (char **)&wnd, sizeof(window));
+	if (argwptr(0, (char **)&wnd, sizeof(window)) < 0)
+		return -1;
 	return closePopupWindow(wnd);
 }
 
 int sys_GUI_createWindow() {
 	window *wnd;
 	char *title;
-	argptr(0, (char **)&wnd, sizeof(window));
+	if (argwptr(0, (char **)&wnd, sizeof(window)) < 0)
+		return -1;
 	argstr(1, &title);
+	if (pinWindowBuffer(wnd) < 0)
+		return 1;
 	return createWindow(wnd, title);
 }
 
 int sys_GUI_closeWindow() {
 	window *wnd;
-	argptr(0, (char **)&wnd, sizeof(window));
+	if (argwptr(0, (char **)&wnd, sizeof(window)) < 0)
+		return -1;
 	return closeWindow(wnd);
 }
 
@@ -825,7 +842,8 @@ int sys_GUI_getMessage() {
 	int h;
 	message *res;
 	argint(0, &h);
-	argptr(1, (char **)(&res), sizeof(message));
+	if (argwptr(1, (char **)(&res), sizeof(message)) < 0)
+		return -1;
 	if (myproc() != windowlist[h].proc) {
 		return 1;
 	}
@@ -834,7 +852,8 @@ int sys_GUI_getMessage() {
 
 int sys_GUI_getPopupMessage() {
 	message *res;
-	argptr(0, (char **)(&res), sizeof(message));
+	if (argwptr(0, (char **)(&res), sizeof(message)) < 0)
+		return -1;
 	if (popupwindow.caller == -1) {
 		return 1;
 	}
@@ -0,0 +1,25 @@
+#include "lockstat.h"
+#include "types.h"
+#include "user.h"
+
+// Print contention counters for the kernel's global spinlocks.
+// Spin time is shown in units of 1024 TSC cycles.
+#define NSTAT 64
+
+int main(int argc, char *argv[]) {
+	static struct lockstat ls[NSTAT];
+	int i, n;
+
+	n = lockstat(ls, NSTAT);
+	if (n < 0) {
+		printf(2, "lockstat: failed\n");
+		exit();
+	}
+
+	printf(1, "name\tlocks\tacquire\tcontended\tkcycles\n");
+	for (i = 0; i < n; i++)
+		printf(1, "%s\t%d\t%d\t%d\t%d\n", ls[i].name, ls[i].nlocks,
+		       ls[i].nacquire, ls[i].ncontended,
+		       (uint)(ls[i].spincycles >> 10));
+	exit();
+}
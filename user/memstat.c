@@ -0,0 +1,28 @@
+#include "memstat.h"
+#include "types.h"
+#include "user.h"
+
+// Print physical memory usage and how fragmented free memory is.
+// For each block order, "unusable" is the share of free memory in
+// blocks too small to satisfy an allocation of that order.
+int main(int argc, char *argv[]) {
+	struct memstat st;
+	uint below;
+	int o;
+
+	if (memstat(&st) < 0) {
+		printf(2, "memstat: failed\n");
+		exit();
+	}
+
+	printf(1, "pages %d free %d cached %d zeroed %d\n", st.npages,
+	       st.nfree, st.ncached, st.nzeroed);
+	printf(1, "order\tkbytes\tblocks\tunusable\n");
+	below = st.ncached + st.nzeroed;
+	for (o = 0; o <= MAXORDER; o++) {
+		printf(1, "%d\t%d\t%d\t%d%%\n", o, 4 << o, st.nblocks[o],
+		       o == 0 || st.nfree == 0 ? 0 : below * 100 / st.nfree);
+		below += st.nblocks[o] << o;
+	}
+	exit();
+}
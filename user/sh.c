@@ -144,7 +144,7 @@ int rfd, wfd;
 
 int main(int argc, char *argv[]) {
 	static char buf[100];
-	int fd;
+	int fd, fds[3] = {0, 1, 2};
 
 	// Ensure that three file descriptors are open.
 	while ((fd = open("console", O_RDWR)) >= 0) {
@@ -156,6 +156,7 @@ int main(int argc, char *argv[]) {
 
 	rfd = (int)argv[1][0];
 	wfd = (int)argv[2][0];
+	fds[1] = wfd;
 	close(0);
 	dup(rfd);
 
@@ -171,7 +172,7 @@ int main(int argc, char *argv[]) {
 				printf(2, "cannot cd %s\n", buf + 3);
 			continue;
 		}
-		if (fork1() == 0) {
+		if (spawncmd(buf, fds) == -2 && fork1() == 0) {
 			close(1);
 			dup(wfd);
 			runcmd(parsecmd(buf));
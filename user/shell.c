@@ -223,9 +223,13 @@ void inputHandler(Widget *w, message *msg) {
 				}
 			}
 
-			int pid = fork();
-			if (pid < 0) {
+			int fd[3] = {0, 1, 2};
+			if (!isGUI && sh2gui_fd[1] >= 0)
+				fd[1] = sh2gui_fd[1];
+			int pid = spawncmd(buffer, fd);
+			if (pid == -2 && (pid = fork()) < 0)
 				printf(2, "fork failed\n");
+			if (pid < 0) {
 				if (sh2gui_fd[0] >= 0) {
 					close(sh2gui_fd[0]);
 					close(sh2gui_fd[1]);
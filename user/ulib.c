@@ -95,3 +95,43 @@ char *strcat(char *dest, const char *src) {
 		;
 	return ret;
 }
+
+#define SPAWNLINE 1000 // Longest command spawncmd takes
+#define SPAWNARGS 10
+
+// Start cmd with spawn() if it is a plain command: one with no
+// redirection, pipes, lists or background jobs, which still need a
+// forked shell to run them. Spawning the program directly spares
+// copying the whole shell only to exec. fd holds the command's
+// descriptors 0, 1 and 2. Returns the child's pid, -1 if the program
+// could not be started, or -2 if cmd is not a plain command.
+int spawncmd(char *cmd, int *fd) {
+	static char whitespace[] = " \t\r\n\v";
+	static char symbols[] = "<|>&;()";
+	char line[SPAWNLINE], *argv[SPAWNARGS], *s;
+	int argc, pid;
+
+	if (strlen(cmd) >= sizeof(line))
+		return -2;
+	strcpy(line, cmd);
+	argc = 0;
+	for (s = line; *s;) {
+		if (strchr(symbols, *s))
+			return -2;
+		if (strchr(whitespace, *s)) {
+			*s++ = 0;
+			continue;
+		}
+		if (argc >= SPAWNARGS - 1)
+			return -2;
+		argv[argc++] = s;
+		while (*s && !strchr(whitespace, *s) && !strchr(symbols, *s))
+			s++;
+	}
+	if (argc == 0)
+		return -2;
+	argv[argc] = 0;
+	if ((pid = spawn(argv[0], argv, fd)) < 0)
+		printf(2, "exec %s failed\n", argv[0]);
+	return pid;
+}